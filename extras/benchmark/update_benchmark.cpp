@@ -0,0 +1,247 @@
+// Host benchmark for TrafficLight::update().
+//
+// Runs the library against the HostBackend with a virtual clock, so the
+// numbers only depend on the CPU and not on the timing of the run.
+//
+// Build and run from the repository root:
+//   g++ -std=c++11 -O2 -pthread -Isrc src/*.cpp
+//       extras/benchmark/update_benchmark.cpp -o update_benchmark
+//   ./update_benchmark
+
+#include <TrafficLight.h>
+
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+namespace {
+
+const long ITERATIONS = 2000000;
+const int RUNS = 5;
+const int BANK_SIZE = 32;
+const int WHEEL_SIZE = 1000;
+const int SIMULATED_HOURS = 4;
+const long TRACE_UPDATES = 200000;
+
+// Standard four phase signal plan
+Phase standard_phases[] = {{{true, false, false}, 30000},
+                           {{true, true, false}, 1000},
+                           {{false, false, true}, 25000},
+                           {{false, true, false}, 3000}};
+
+// Plan with one millisecond phases, so every update changes the phase
+Phase fast_phases[] = {{{true, false, false}, 1},
+                       {{true, true, false}, 1},
+                       {{false, false, true}, 1},
+                       {{false, true, false}, 1}};
+
+HostBackend backend;
+volatile unsigned long callback_count = 0;
+
+void on_event() { callback_count++; }
+
+void append_trace(void *context, const uint8_t *data, size_t size) {
+  std::vector<uint8_t> *trace = static_cast<std::vector<uint8_t> *>(context);
+  trace->insert(trace->end(), data, data + size);
+}
+
+// Light with all inputs in use, recorded and replayed the same way
+void setup_traced_light(TrafficLight &light) {
+  light.set_cycle_phases(fast_phases, 4);
+  light.set_activity_cycle_times(60000, 10000);
+  light.enable_activity_cycle();
+  light.enable_cycle();
+  light.set_test_pins(14, 15, 16);
+}
+
+template <typename Body> double measure_ns(long iterations, Body body) {
+  double best = 0;
+  for (int run = 0; run < RUNS; run++) {
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+      body();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double ns =
+        std::chrono::duration<double, std::nano>(end - start).count() /
+        iterations;
+    if (run == 0 || ns < best) {
+      best = ns;
+    }
+  }
+  return best;
+}
+
+void report(const char *name, double ns) {
+  printf("%-36s %10.2f ns/op\n", name, ns);
+}
+
+} // namespace
+
+int main() {
+  hal::set_backend(&backend);
+
+  {
+    TrafficLight light(2, 3, 4);
+    light.set_cycle_phases(standard_phases, 4);
+    light.enable_cycle();
+    report("update() idle", measure_ns(ITERATIONS, [&] { light.update(); }));
+  }
+
+  {
+    TrafficLight light(2, 3, 4);
+    light.set_cycle_phases(standard_phases, 4);
+    light.set_activity_cycle_times(600000, 60000);
+    light.enable_activity_cycle();
+    light.enable_cycle();
+    light.set_test_pins(14, 15, 16);
+    report("update() idle, activity + defects",
+           measure_ns(ITERATIONS, [&] {
+             backend.advance_ms(1);
+             light.update();
+           }));
+  }
+
+  {
+    TrafficLight light(2, 3, 4);
+    light.set_cycle_phases(fast_phases, 4);
+    light.register_event(EventName::CYCLE_PHASE_CHANGED, on_event);
+    light.enable_cycle();
+    report("update() with phase change", measure_ns(ITERATIONS, [&] {
+             backend.advance_ms(1);
+             light.update();
+           }));
+  }
+
+  {
+    TrafficLight *lights[BANK_SIZE];
+    for (int i = 0; i < BANK_SIZE; i++) {
+      lights[i] = new TrafficLight(2, 3, 4);
+      lights[i]->set_cycle_phases(standard_phases, 4);
+      lights[i]->enable_cycle();
+    }
+    report("32 x TrafficLight::update()",
+           measure_ns(ITERATIONS / BANK_SIZE, [&] {
+             backend.advance_ms(1);
+             for (int i = 0; i < BANK_SIZE; i++) {
+               lights[i]->update();
+             }
+           }));
+    for (int i = 0; i < BANK_SIZE; i++) {
+      delete lights[i];
+    }
+  }
+
+  {
+    static TrafficLightBank<BANK_SIZE> bank;
+    for (int i = 0; i < BANK_SIZE; i++) {
+      BankedTrafficLight light = bank.add(2, 3, 4);
+      light.set_cycle_phases(standard_phases, 4);
+      light.enable_cycle();
+    }
+    report("TrafficLightBank<32>::update()",
+           measure_ns(ITERATIONS / BANK_SIZE, [&] {
+             backend.advance_ms(1);
+             bank.update();
+           }));
+  }
+
+  {
+    static TimerWheel wheel;
+    TrafficLight *lights[WHEEL_SIZE];
+    for (int i = 0; i < WHEEL_SIZE; i++) {
+      lights[i] = new TrafficLight(2, 3, 4);
+      lights[i]->set_cycle_phases(standard_phases, 4);
+      lights[i]->enable_cycle();
+    }
+    report("1000 x TrafficLight::update() tick",
+           measure_ns(ITERATIONS / WHEEL_SIZE, [&] {
+             backend.advance_ms(1);
+             for (int i = 0; i < WHEEL_SIZE; i++) {
+               lights[i]->update();
+             }
+           }));
+    for (int i = 0; i < WHEEL_SIZE; i++) {
+      lights[i]->attach_scheduler(wheel);
+    }
+    report("TimerWheel::update() tick, 1000 lights",
+           measure_ns(ITERATIONS / WHEEL_SIZE, [&] {
+             backend.advance_ms(1);
+             wheel.update();
+           }));
+    for (int i = 0; i < WHEEL_SIZE; i++) {
+      delete lights[i];
+    }
+  }
+
+  {
+    static Simulator<WHEEL_SIZE> simulator(backend);
+    TrafficLight *lights[WHEEL_SIZE];
+    for (int i = 0; i < WHEEL_SIZE; i++) {
+      // Stagger the lights, so they do not all change at the same time
+      backend.advance_ms(59);
+      lights[i] = new TrafficLight(2, 3, 4);
+      lights[i]->set_cycle_phases(standard_phases, 4);
+      lights[i]->enable_cycle();
+      simulator.add(*lights[i]);
+    }
+    report("Simulator, per light-hour",
+           measure_ns(SIMULATED_HOURS, [&] {
+             simulator.run_for(3600000UL);
+           }) / WHEEL_SIZE);
+    simulator.clear();
+    for (int i = 0; i < WHEEL_SIZE; i++) {
+      delete lights[i];
+    }
+  }
+
+  {
+    std::vector<uint8_t> trace;
+    {
+      TraceRecorder recorder(backend, append_trace, &trace);
+      hal::set_backend(&recorder);
+      TrafficLight light(2, 3, 4);
+      setup_traced_light(light);
+      recorder.attach(light);
+      for (long i = 0; i < TRACE_UPDATES; i++) {
+        backend.advance_ms(1);
+        light.update();
+      }
+      recorder.detach(light);
+      hal::set_backend(&backend);
+    }
+
+    TraceReplayer replayer(trace.data(), trace.size());
+    hal::set_backend(&replayer);
+    report("trace replay, per update()", measure_ns(1, [&] {
+             replayer.rewind();
+             TrafficLight light(2, 3, 4);
+             setup_traced_light(light);
+             replayer.attach(light);
+             while (!replayer.is_finished()) {
+               light.update();
+             }
+             replayer.detach(light);
+           }) / TRACE_UPDATES);
+    hal::set_backend(&backend);
+    printf("trace: %.2f bytes per update, %lu event mismatches\n",
+           static_cast<double>(trace.size()) / TRACE_UPDATES,
+           replayer.get_mismatch_count());
+  }
+
+  {
+    EventManager event_manager;
+    event_manager.connect(EventName::CYCLE_PHASE_CHANGED, on_event);
+    report("emit() connected", measure_ns(ITERATIONS, [&] {
+             event_manager.emit(EventName::CYCLE_PHASE_CHANGED);
+           }));
+    report("emit() unconnected", measure_ns(ITERATIONS, [&] {
+             event_manager.emit(EventName::CYCLE_FINISHED);
+           }));
+  }
+
+  printf("digital writes: %lu, analog reads: %lu, callbacks: %lu\n",
+         backend.get_digital_write_count(), backend.get_analog_read_count(),
+         callback_count);
+  return 0;
+}
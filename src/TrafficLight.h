@@ -1,8 +1,34 @@
 #ifndef TRAFFIC_LIGHT_LIBRARY_H
 #define TRAFFIC_LIGHT_LIBRARY_H
 
+#include "arduino_backend.h"
+#include "avr_timer1.h"
+#include "conflict_monitor.h"
+#include "coordination_clock.h"
+#include "defect_monitor.h"
+#include "detector.h"
+#include "event_queue.h"
 #include "events.h"
+#include "file_phase_source.h"
+#include "hal.h"
+#include "host_backend.h"
+#include "instrumentation.h"
+#include "interrupt_timer.h"
+#include "parallel_simulator.h"
 #include "phase.h"
+#include "phase_effect.h"
+#include "phase_source.h"
+#include "plan_scheduler.h"
+#include "shared_state_table.h"
+#include "signal_head.h"
+#include "simulator.h"
+#include "state_publisher.h"
+#include "state_snapshot.h"
+#include "timer_wheel.h"
+#include "timerfd_timer.h"
+#include "timing_mode.h"
+#include "trace.h"
 #include "traffic_light.h"
+#include "traffic_light_bank.h"
 
 #endif
\ No newline at end of file
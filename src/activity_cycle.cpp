@@ -1,10 +1,10 @@
 #include "activity_cycle.h"
-#include <Arduino.h>
+#include "hal.h"
 #include <stdint.h>
 
 ActivityCycle::ActivityCycle()
     : state(ActivityCycleState::ACTIVE), active_time_ms(0), inactive_time_ms(0),
-      last_time_ms(0) {
+      last_time_ms(0), timing_mode(TimingMode::RELATIVE) {
   // Initialize flags (all flags cleared by default)
   flags = 0;
 }
@@ -19,16 +19,40 @@ bool ActivityCycle::has_state_changed() {
 
 ActivityCycleState ActivityCycle::get_state() { return state; }
 
+unsigned long ActivityCycle::get_state_start_time() { return last_time_ms; }
+
+bool ActivityCycle::get_next_deadline(unsigned long &deadline_ms) {
+  if (!is_enabled())
+    return false;
+  deadline_ms = last_time_ms + get_state_duration();
+  return true;
+}
+
+bool ActivityCycle::is_behind(unsigned long now) {
+  if (!is_enabled())
+    return false;
+  return now - last_time_ms >= get_state_duration();
+}
+
 void ActivityCycle::set_times(unsigned long active_time_ms,
                               unsigned long inactive_time_ms) {
   this->active_time_ms = active_time_ms;
   this->inactive_time_ms = inactive_time_ms;
 }
 
+void ActivityCycle::set_timing_mode(TimingMode mode) { timing_mode = mode; }
+
 void ActivityCycle::enable() {
   flags = (1 << FLAG_ENABLED); // Set enabled, clear other flags
   state = ActivityCycleState::ACTIVE;
-  last_time_ms = millis();
+  last_time_ms = hal::millis();
+}
+
+void ActivityCycle::restore(ActivityCycleState state,
+                            unsigned long elapsed_ms) {
+  flags = (1 << FLAG_ENABLED); // Set enabled, clear other flags
+  this->state = state;
+  last_time_ms = hal::millis() - elapsed_ms;
 }
 
 void ActivityCycle::disable() {
@@ -43,19 +67,43 @@ void ActivityCycle::update() {
   if (!is_enabled())
     return;
 
-  unsigned long now = millis();
+  unsigned long now = hal::millis();
   unsigned long elapsed = now - last_time_ms;
-  unsigned long target_duration =
-      (state == ActivityCycleState::ACTIVE) ? active_time_ms : inactive_time_ms;
 
   // Check if current state duration has elapsed
-  if (elapsed < target_duration) {
+  if (elapsed < get_state_duration()) {
     return;
   }
 
-  // Toggle state
+  if (timing_mode == TimingMode::RELATIVE) {
+    toggle_state();
+    last_time_ms = now;
+  } else if (timing_mode == TimingMode::ABSOLUTE_REPLAY) {
+    // One state per update, is_behind() tells if more states are missed
+    toggle_state();
+  } else {
+    toggle_state();
+
+    // Skip complete periods at once, then at most one more state is missed
+    unsigned long period_ms = active_time_ms + inactive_time_ms;
+    if (period_ms > 0) {
+      last_time_ms += ((now - last_time_ms) / period_ms) * period_ms;
+    }
+    if (now - last_time_ms >= get_state_duration()) {
+      toggle_state();
+    }
+  }
+
+  flags |= (1 << FLAG_STATE_CHANGED);
+}
+
+unsigned long ActivityCycle::get_state_duration() {
+  return (state == ActivityCycleState::ACTIVE) ? active_time_ms
+                                               : inactive_time_ms;
+}
+
+void ActivityCycle::toggle_state() {
+  last_time_ms += get_state_duration();
   state = (state == ActivityCycleState::ACTIVE) ? ActivityCycleState::INACTIVE
                                                 : ActivityCycleState::ACTIVE;
-  flags |= (1 << FLAG_STATE_CHANGED);
-  last_time_ms = now;
 }
\ No newline at end of file
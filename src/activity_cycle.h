@@ -1,6 +1,7 @@
 #ifndef ACTIVITY_CYCLE_H
 #define ACTIVITY_CYCLE_H
 
+#include "timing_mode.h"
 #include <stdint.h>
 
 enum class ActivityCycleState { ACTIVE, INACTIVE };
@@ -14,13 +15,25 @@ private:
   ActivityCycleState state;
   unsigned long active_time_ms;
   unsigned long inactive_time_ms;
-  unsigned long last_time_ms;
+  unsigned long last_time_ms; // Start of the current state
+  TimingMode timing_mode;
   uint8_t flags; // Bitfield for boolean flags
 
   // Disable copy constructor and assignment
   ActivityCycle(const ActivityCycle &) = delete;
   ActivityCycle &operator=(const ActivityCycle &) = delete;
 
+  /**
+   * Gets the duration of the current state.
+   * @return The duration in milliseconds.
+   */
+  unsigned long get_state_duration();
+
+  /**
+   * Switches to the other state, starting at the end of the current one.
+   */
+  void toggle_state();
+
 public:
   ActivityCycle();
   ~ActivityCycle() = default;
@@ -43,6 +56,29 @@ public:
    */
   ActivityCycleState get_state();
 
+  /**
+   * Gets the point in time the current state started. Differs from the time
+   * of the update() noticing the change unless the timing mode is RELATIVE.
+   * @return The start of the state in milliseconds.
+   */
+  unsigned long get_state_start_time();
+
+  /**
+   * Gets the point in time the current state ends.
+   * @param deadline_ms Set to the end of the state in milliseconds.
+   * @return True if the activity cycle is enabled, false if there is no
+   * deadline.
+   */
+  bool get_next_deadline(unsigned long &deadline_ms);
+
+  /**
+   * Checks if the current state has already ended, i.e. update() has to be
+   * called again to replay missed state changes.
+   * @param now The current time in milliseconds.
+   * @return True if the activity cycle is running behind, false otherwise.
+   */
+  bool is_behind(unsigned long now);
+
   /**
    * Sets the times for the active and inactive states.
    * @param active_time_ms Time in milliseconds for the active state.
@@ -50,11 +86,24 @@ public:
    */
   void set_times(unsigned long active_time_ms, unsigned long inactive_time_ms);
 
+  /**
+   * Sets how state changes are scheduled when update() runs late.
+   * @param mode The timing mode, RELATIVE by default.
+   */
+  void set_timing_mode(TimingMode mode);
+
   /**
    * Enables the activity cycle.
    */
   void enable();
 
+  /**
+   * Enables the activity cycle in a saved state, e.g. after a reset.
+   * @param state The state to continue with.
+   * @param elapsed_ms The time the state has already lasted.
+   */
+  void restore(ActivityCycleState state, unsigned long elapsed_ms);
+
   /**
    * Disables the activity cycle.
    */
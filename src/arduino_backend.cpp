@@ -0,0 +1,93 @@
+#ifdef ARDUINO
+
+#include "arduino_backend.h"
+
+#ifdef __AVR__
+#include <avr/sleep.h>
+#endif
+
+unsigned long ArduinoBackend::millis() { return ::millis(); }
+
+void ArduinoBackend::pin_mode(int pin, PinMode mode) {
+  switch (mode) {
+  case PinMode::OUTPUT_MODE:
+    pinMode(pin, OUTPUT);
+    break;
+  case PinMode::INPUT_PULLUP_MODE:
+    pinMode(pin, INPUT_PULLUP);
+    break;
+  default:
+    pinMode(pin, INPUT);
+    break;
+  }
+}
+
+void ArduinoBackend::digital_write(int pin, bool value) {
+  digitalWrite(pin, value ? HIGH : LOW);
+}
+
+void ArduinoBackend::analog_write(int pin, uint8_t value) {
+  analogWrite(pin, value);
+}
+
+int ArduinoBackend::analog_read(int pin) { return analogRead(pin); }
+
+bool ArduinoBackend::digital_read(int pin) { return digitalRead(pin) == HIGH; }
+
+void ArduinoBackend::idle_until(unsigned long deadline_ms) {
+#ifdef __AVR__
+  // The timer 0 overflow interrupt wakes the CPU about every millisecond
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  while (!hal::time_reached(::millis(), deadline_ms)) {
+    sleep_enable();
+    sleep_cpu();
+    sleep_disable();
+  }
+#else
+  unsigned long now = ::millis();
+  if (!hal::time_reached(now, deadline_ms)) {
+    delay(deadline_ms - now);
+  }
+#endif
+}
+
+#if defined(__AVR__) && defined(portOutputRegister)
+bool ArduinoBackend::bind_port(const int *pins, int count,
+                               PortBinding &binding) {
+  if (count <= 0 || count > PortBinding::MAX_PINS)
+    return false;
+
+  uint8_t port = digitalPinToPort(pins[0]);
+  if (port == NOT_A_PIN)
+    return false;
+
+  binding.all_bits = 0;
+  for (int i = 0; i < count; i++) {
+    if (digitalPinToPort(pins[i]) != port)
+      return false; // Pins are spread over several ports
+    binding.bits[i] = digitalPinToBitMask(pins[i]);
+    binding.all_bits |= binding.bits[i];
+  }
+  binding.port = reinterpret_cast<uintptr_t>(portOutputRegister(port));
+  binding.count = count;
+  return true;
+}
+
+void ArduinoBackend::write_port(const PortBinding &binding, uint8_t mask) {
+  volatile uint8_t *reg = reinterpret_cast<volatile uint8_t *>(binding.port);
+
+  uint8_t bits = 0;
+  for (uint8_t i = 0; i < binding.count; i++) {
+    if (mask & (1 << i))
+      bits |= binding.bits[i];
+  }
+
+  // Read-modify-write must not be interrupted by code writing the same port
+  uint8_t old_sreg = SREG;
+  cli();
+  *reg = (*reg & ~binding.all_bits) | bits;
+  SREG = old_sreg;
+}
+#endif
+
+#endif
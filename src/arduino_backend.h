@@ -0,0 +1,37 @@
+#ifndef ARDUINO_BACKEND_H
+#define ARDUINO_BACKEND_H
+
+#ifdef ARDUINO
+
+#include "hal.h"
+
+#include <Arduino.h>
+
+/**
+ * Backend forwarding to the Arduino core functions.
+ * This is the default backend on Arduino boards.
+ * On AVR boards output pins sharing a port can be written with one register
+ * access. Pins driven this way must not be used for PWM.
+ * Idling puts AVR boards into idle sleep, which is left on every timer
+ * interrupt. Other boards idle with delay(), which lets an RTOS run other
+ * tasks.
+ */
+class ArduinoBackend : public HardwareBackend {
+public:
+  unsigned long millis() override;
+  void pin_mode(int pin, PinMode mode) override;
+  void digital_write(int pin, bool value) override;
+  void analog_write(int pin, uint8_t value) override;
+  int analog_read(int pin) override;
+  bool digital_read(int pin) override;
+  void idle_until(unsigned long deadline_ms) override;
+
+#if defined(__AVR__) && defined(portOutputRegister)
+  bool bind_port(const int *pins, int count, PortBinding &binding) override;
+  void write_port(const PortBinding &binding, uint8_t mask) override;
+#endif
+};
+
+#endif
+
+#endif
@@ -0,0 +1,71 @@
+#if defined(ARDUINO) && defined(__AVR__)
+
+#include "avr_timer1.h"
+#include "hal.h"
+
+namespace {
+constexpr unsigned long TICKS_PER_SECOND = F_CPU / 1024UL;
+constexpr unsigned long MAX_DELAY_MS = 60000; // Keeps the tick math in range
+constexpr unsigned long MAX_TICKS = 0xFFFF;
+// A match closer than this may be passed before it is written
+constexpr unsigned long MIN_TICKS = 2;
+} // namespace
+
+AvrTimer1::~AvrTimer1() { end(); }
+
+bool AvrTimer1::start() {
+  uint8_t old_sreg = SREG;
+  cli();
+  TIMSK1 &= ~_BV(OCIE1A);
+  TCCR1A = 0;                     // Normal mode, output compare pins off
+  TCCR1B = _BV(CS12) | _BV(CS10); // Prescaler 1024
+  SREG = old_sreg;
+  return true;
+}
+
+void AvrTimer1::stop() {
+  TIMSK1 &= ~_BV(OCIE1A);
+  TCCR1B = 0;
+}
+
+void AvrTimer1::arm(unsigned long deadline_ms) {
+  unsigned long now = ::millis();
+  unsigned long delay_ms =
+      hal::time_reached(now, deadline_ms) ? 0 : deadline_ms - now;
+  if (delay_ms > MAX_DELAY_MS) {
+    delay_ms = MAX_DELAY_MS;
+  }
+
+  // Deadlines out of range expire early and are armed again
+  unsigned long ticks = delay_ms * TICKS_PER_SECOND / 1000UL;
+  if (ticks < MIN_TICKS) {
+    ticks = MIN_TICKS;
+  } else if (ticks > MAX_TICKS) {
+    ticks = MAX_TICKS;
+  }
+
+  // The counter runs freely, the match is set relative to it
+  OCR1A = TCNT1 + static_cast<uint16_t>(ticks);
+  TIFR1 = _BV(OCF1A); // Drop a match of the previous deadline
+  TIMSK1 |= _BV(OCIE1A);
+}
+
+void AvrTimer1::disarm() { TIMSK1 &= ~_BV(OCIE1A); }
+
+void AvrTimer1::lock() {
+  uint8_t old_sreg = SREG;
+  cli();
+  TIMSK1 &= ~_BV(OCIE1A);
+  SREG = old_sreg;
+}
+
+void AvrTimer1::unlock() {
+  uint8_t old_sreg = SREG;
+  cli();
+  rearm();
+  SREG = old_sreg;
+}
+
+void AvrTimer1::handle_interrupt() { handle_expiry(); }
+
+#endif
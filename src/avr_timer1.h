@@ -0,0 +1,53 @@
+#ifndef AVR_TIMER1_H
+#define AVR_TIMER1_H
+
+#if defined(ARDUINO) && defined(__AVR__)
+
+#include "interrupt_timer.h"
+
+#include <Arduino.h>
+
+/**
+ * Drives a TimerWheel from the compare match A interrupt of timer 1 of AVR
+ * boards. The timer counts with a prescaler of 1024 (64 us at 16 MHz) and
+ * is armed for the next deadline, so it only interrupts when a traffic light
+ * changes, at the latest every ~4 s.
+ * Timer 1 can not be shared: the Servo library and PWM on the pins of timer
+ * 1 (9 and 10 on the Uno) stop working. The interrupt handler is not part
+ * of the library, so sketches not using the timer keep it free; add it to
+ * the sketch with TRAFFIC_LIGHT_TIMER1_ISR().
+ */
+class AvrTimer1 : public InterruptTimer {
+protected:
+  bool start() override;
+  void stop() override;
+  void arm(unsigned long deadline_ms) override;
+  void disarm() override;
+
+public:
+  AvrTimer1() = default;
+  ~AvrTimer1() override;
+
+  /**
+   * Masks the timer interrupt, other interrupts keep running.
+   */
+  void lock() override;
+  void unlock() override;
+
+  /**
+   * Handles the compare match interrupt, called by TRAFFIC_LIGHT_TIMER1_ISR().
+   */
+  void handle_interrupt();
+};
+
+/**
+ * Defines the timer 1 interrupt handler for a timer, place it once in the
+ * sketch at file scope.
+ * @param timer The AvrTimer1 object.
+ */
+#define TRAFFIC_LIGHT_TIMER1_ISR(timer)                                        \
+  ISR(TIMER1_COMPA_vect) { (timer).handle_interrupt(); }
+
+#endif
+
+#endif
@@ -0,0 +1,126 @@
+#include "conflict_monitor.h"
+#include "hal.h"
+#include "traffic_light.h"
+
+ConflictMonitorBase::ConflictMonitorBase(TrafficLight **heads,
+                                         uint32_t *conflicts,
+                                         uint8_t capacity)
+    : heads(heads), conflicts(conflicts), capacity(capacity), head_count(0),
+      proceed_lamps(0x04), flags(0), proceed_mask(0), conflict_mask(0),
+      fail_safe_effect{-1, 0x01, LampEffect::FLASH, 1000, 500, nullptr},
+      fail_safe_flash() {
+  for (uint8_t i = 0; i < capacity; i++) {
+    heads[i] = nullptr;
+    conflicts[i] = 0;
+  }
+}
+
+int ConflictMonitorBase::add(TrafficLight &light) {
+  if (head_count >= capacity)
+    return -1;
+
+  int head = head_count++;
+  heads[head] = &light;
+  light.set_conflict_monitor(this, head);
+  return head;
+}
+
+void ConflictMonitorBase::remove(TrafficLight &light) {
+  for (uint8_t i = 0; i < head_count; i++) {
+    if (heads[i] == &light) {
+      heads[i] = nullptr;
+      proceed_mask &= ~(1UL << i);
+      light.set_conflict_monitor(nullptr, -1);
+    }
+  }
+}
+
+bool ConflictMonitorBase::set_conflicts(const Conflict *table, int count) {
+  for (int i = 0; i < count; i++) {
+    if (table[i].head_a >= capacity || table[i].head_b >= capacity)
+      return false;
+  }
+
+  for (uint8_t i = 0; i < capacity; i++) {
+    conflicts[i] = 0;
+  }
+  for (int i = 0; i < count; i++) {
+    if (table[i].head_a == table[i].head_b)
+      continue;
+    conflicts[table[i].head_a] |= 1UL << table[i].head_b;
+    conflicts[table[i].head_b] |= 1UL << table[i].head_a;
+  }
+  return true;
+}
+
+void ConflictMonitorBase::set_proceed_lamps(uint8_t lamps) {
+  proceed_lamps = lamps;
+}
+
+void ConflictMonitorBase::set_fail_safe_flash(uint8_t lamps,
+                                              uint16_t period_ms,
+                                              uint16_t on_ms) {
+  fail_safe_effect.lamps = lamps;
+  fail_safe_effect.period_ms = period_ms;
+  fail_safe_effect.on_ms = on_ms;
+}
+
+bool ConflictMonitorBase::check(int head, uint8_t mask) {
+  if (flags & (1 << FLAG_FAIL_SAFE))
+    return false;
+
+  uint32_t bit = 1UL << head;
+  if ((mask & proceed_lamps) == 0) {
+    proceed_mask &= ~bit;
+    return true;
+  }
+
+  proceed_mask |= bit;
+  uint32_t conflicting = proceed_mask & conflicts[head];
+  if (conflicting == 0)
+    return true;
+
+  conflict_mask = conflicting | bit;
+  enter_fail_safe();
+  return false;
+}
+
+void ConflictMonitorBase::enter_fail_safe() {
+  flags |= (1 << FLAG_FAIL_SAFE);
+  proceed_mask = 0;
+  fail_safe_flash.start(&fail_safe_effect, hal::millis());
+
+  for (uint8_t i = 0; i < head_count; i++) {
+    if (heads[i] != nullptr) {
+      heads[i]->enter_fail_safe();
+    }
+  }
+}
+
+bool ConflictMonitorBase::is_fail_safe() {
+  return (flags & (1 << FLAG_FAIL_SAFE)) != 0;
+}
+
+uint32_t ConflictMonitorBase::get_conflict_heads() { return conflict_mask; }
+
+uint8_t ConflictMonitorBase::get_fail_safe_mask(unsigned long now) {
+  fail_safe_flash.update(now);
+  return fail_safe_flash.get_mask(fail_safe_effect.lamps);
+}
+
+bool ConflictMonitorBase::get_next_deadline(unsigned long &deadline_ms) {
+  return is_fail_safe() && fail_safe_flash.get_next_deadline(deadline_ms);
+}
+
+void ConflictMonitorBase::reset() {
+  flags &= ~(1 << FLAG_FAIL_SAFE);
+  conflict_mask = 0;
+  fail_safe_flash.stop();
+
+  // Write the dark pattern the heads were left with
+  for (uint8_t i = 0; i < head_count; i++) {
+    if (heads[i] != nullptr) {
+      heads[i]->set_pattern(false, false, false);
+    }
+  }
+}
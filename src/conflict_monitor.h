@@ -0,0 +1,154 @@
+#ifndef CONFLICT_MONITOR_H
+#define CONFLICT_MONITOR_H
+
+#include "phase_effect.h"
+#include <stdint.h>
+
+class TrafficLight;
+
+/**
+ * Two heads of an intersection that must never show green at the same time.
+ */
+struct Conflict {
+  uint8_t head_a;
+  uint8_t head_b;
+};
+
+/**
+ * Checks that conflicting heads never show green together.
+ * The conflict table is compiled into one bitmask per head, so checking a
+ * pattern is a couple of AND operations. Every traffic light added checks
+ * its pattern before writing it to the lamps. A conflict is not written:
+ * all heads switch to a fail-safe flash (red by default) and the lights of
+ * the conflict emit CONFLICT. The monitor stays in fail-safe until reset().
+ * Plans must give conflicting heads a clearance time (e.g. all red) between
+ * their greens, heads switching green at the same moment count as conflict.
+ */
+class ConflictMonitorBase {
+public:
+  static constexpr int MAX_HEADS = 32;
+
+private:
+  // Bit positions for flags
+  static constexpr uint8_t FLAG_FAIL_SAFE = 0;
+
+  TrafficLight **heads;
+  uint32_t *conflicts; // Bit j of entry i set if heads i and j conflict
+  uint8_t capacity;
+  uint8_t head_count;
+  uint8_t proceed_lamps;  // Lamps letting traffic go, green by default
+  uint8_t flags;          // Bitfield for boolean flags
+  uint32_t proceed_mask;  // Heads showing a proceed lamp
+  uint32_t conflict_mask; // Heads of the conflict causing the fail-safe
+  PhaseEffect fail_safe_effect;
+  EffectPlayer fail_safe_flash;
+
+  // Disable copy constructor and assignment
+  ConflictMonitorBase(const ConflictMonitorBase &) = delete;
+  ConflictMonitorBase &operator=(const ConflictMonitorBase &) = delete;
+
+  /**
+   * Latches the fail-safe and switches all heads to it.
+   */
+  void enter_fail_safe();
+
+protected:
+  ConflictMonitorBase(TrafficLight **heads, uint32_t *conflicts,
+                      uint8_t capacity);
+  ~ConflictMonitorBase() = default;
+
+public:
+  /**
+   * Adds a traffic light as the next head.
+   * @param light The traffic light, must stay valid while it is added.
+   * @return The index of the head, -1 if the monitor is full.
+   */
+  int add(TrafficLight &light);
+
+  /**
+   * Removes a traffic light, its index stays unused.
+   * @param light The traffic light.
+   */
+  void remove(TrafficLight &light);
+
+  /**
+   * Sets the conflicting heads. Heads missing in the table may show green
+   * together with any other head.
+   * @param table The pairs of conflicting heads.
+   * @param count The number of pairs.
+   * @return True if all heads of the table fit into the monitor, false
+   * otherwise (no conflicts are set then).
+   */
+  bool set_conflicts(const Conflict *table, int count);
+
+  /**
+   * Sets the lamps letting traffic go.
+   * @param lamps Bit i set for light i (0: red, 1: yellow, 2: green), green
+   * only by default.
+   */
+  void set_proceed_lamps(uint8_t lamps);
+
+  /**
+   * Sets the flash shown by all heads in fail-safe.
+   * @param lamps Bit i set for light i, red only by default.
+   * @param period_ms The length of one on/off period in milliseconds.
+   * @param on_ms The on time per period in milliseconds.
+   */
+  void set_fail_safe_flash(uint8_t lamps, uint16_t period_ms = 1000,
+                           uint16_t on_ms = 500);
+
+  /**
+   * Checks the pattern of a head before it is written, called by the head.
+   * @param head The index of the head.
+   * @param mask The lamps to turn on, bit i set for light i.
+   * @return True if the pattern can be written, false if the monitor is in
+   * fail-safe, possibly because of this pattern.
+   */
+  bool check(int head, uint8_t mask);
+
+  /**
+   * Checks if a conflict was detected.
+   * @return True if the heads show the fail-safe flash, false otherwise.
+   */
+  bool is_fail_safe();
+
+  /**
+   * Gets the heads of the conflict that caused the fail-safe.
+   * @return Bit i set for head i, 0 if not in fail-safe.
+   */
+  uint32_t get_conflict_heads();
+
+  /**
+   * Gets the lamps the heads show in fail-safe.
+   * @param now The current time in milliseconds.
+   * @return The lamps to turn on, bit i set for light i.
+   */
+  uint8_t get_fail_safe_mask(unsigned long now);
+
+  /**
+   * Gets the point in time the fail-safe flash next toggles.
+   * @param deadline_ms Set to the deadline in milliseconds.
+   * @return True if in fail-safe, false otherwise.
+   */
+  bool get_next_deadline(unsigned long &deadline_ms);
+
+  /**
+   * Leaves the fail-safe after the cause was fixed. The heads stay dark
+   * until their cycles are enabled again.
+   */
+  void reset();
+};
+
+template <int HEADS = 8> class ConflictMonitor : public ConflictMonitorBase {
+  static_assert(HEADS > 0 && HEADS <= MAX_HEADS,
+                "Heads must be between 1 and 32");
+
+private:
+  TrafficLight *heads[HEADS];
+  uint32_t conflicts[HEADS];
+
+public:
+  ConflictMonitor() : ConflictMonitorBase(heads, conflicts, HEADS) {}
+};
+
+#endif
@@ -0,0 +1,47 @@
+#include "coordination_clock.h"
+
+CoordinationClock::CoordinationClock(unsigned long cycle_length_ms,
+                                     unsigned long reference_ms)
+    : reference_ms(reference_ms), cycle_length_ms(cycle_length_ms) {}
+
+unsigned long CoordinationClock::get_cycle_length_ms() {
+  return cycle_length_ms;
+}
+
+unsigned long CoordinationClock::get_reference_ms() { return reference_ms; }
+
+unsigned long
+CoordinationClock::get_position_ms(unsigned long now, unsigned long offset_ms,
+                                   unsigned long cycle_length_ms) {
+  if (this->cycle_length_ms > 0) {
+    cycle_length_ms = this->cycle_length_ms;
+    roll_reference(now);
+  }
+  if (cycle_length_ms == 0) {
+    return 0;
+  }
+
+  // Signed, so times before the reference wrap into the previous cycle
+  long since = static_cast<long>(now - reference_ms - offset_ms);
+  long position = since % static_cast<long>(cycle_length_ms);
+  if (position < 0) {
+    position += cycle_length_ms;
+  }
+  return position;
+}
+
+void CoordinationClock::roll_reference(unsigned long now) {
+  // A reference in the future is kept, positions before it wrap back
+  unsigned long since = now - reference_ms;
+  if (static_cast<long>(since) >= static_cast<long>(cycle_length_ms)) {
+    reference_ms += since - since % cycle_length_ms;
+  }
+}
+
+void CoordinationClock::set_cycle_length_ms(unsigned long cycle_length_ms) {
+  this->cycle_length_ms = cycle_length_ms;
+}
+
+void CoordinationClock::set_reference_ms(unsigned long reference_ms) {
+  this->reference_ms = reference_ms;
+}
@@ -0,0 +1,86 @@
+#ifndef COORDINATION_CLOCK_H
+#define COORDINATION_CLOCK_H
+
+/**
+ * Shared cycle reference for coordinated traffic lights, e.g. a green wave.
+ * All lights coordinated by the same clock count their cycles from the same
+ * reference time, each shifted by its own offset. A light computes its phase
+ * from the position within the shared cycle instead of timing its phases one
+ * after another, so lights never drift apart.
+ *
+ * With a shared cycle length the reference is moved forward by whole cycles
+ * as the lights sync, so positions stay exact however long the lights run.
+ * Lights using the total duration of their own phases cannot share that,
+ * on boards with a 32 bit long their phases jump once every 2^31 ms (24.8
+ * days) after the reference. Give such lights a shared cycle length, or set
+ * a new reference before then.
+ */
+class CoordinationClock {
+private:
+  unsigned long reference_ms;
+  unsigned long cycle_length_ms;
+
+  // Disable copy constructor and assignment
+  CoordinationClock(const CoordinationClock &) = delete;
+  CoordinationClock &operator=(const CoordinationClock &) = delete;
+
+  /**
+   * Moves the reference forward by whole shared cycles to the last cycle
+   * start before a point in time, so the time since the reference never
+   * overflows a signed long.
+   * @param now The current time in milliseconds.
+   */
+  void roll_reference(unsigned long now);
+
+public:
+  /**
+   * Constructor for the CoordinationClock class.
+   * @param cycle_length_ms The length of the shared cycle in milliseconds, 0
+   * to let every light use the total duration of its phases.
+   * @param reference_ms The point in time a shared cycle started.
+   */
+  explicit CoordinationClock(unsigned long cycle_length_ms = 0,
+                             unsigned long reference_ms = 0);
+
+  /**
+   * Gets the length of the shared cycle.
+   * @return The length in milliseconds, 0 if every light uses its own.
+   */
+  unsigned long get_cycle_length_ms();
+
+  /**
+   * Gets the point in time a shared cycle started, a recent one once the
+   * reference was moved forward.
+   * @return The reference time in milliseconds.
+   */
+  unsigned long get_reference_ms();
+
+  /**
+   * Gets the position of a light within its cycle.
+   * @param now The current time in milliseconds.
+   * @param offset_ms The offset of the light in milliseconds.
+   * @param cycle_length_ms The length of the light's cycle in milliseconds,
+   * used if the clock has no cycle length.
+   * @return The time since the light's cycle started in milliseconds.
+   */
+  unsigned long get_position_ms(unsigned long now, unsigned long offset_ms,
+                                unsigned long cycle_length_ms);
+
+  /**
+   * Sets the length of the shared cycle.
+   * Coordinated lights pick up the change at their next phase change.
+   * @param cycle_length_ms The length in milliseconds, 0 to let every light
+   * use the total duration of its phases.
+   */
+  void set_cycle_length_ms(unsigned long cycle_length_ms);
+
+  /**
+   * Sets the point in time a shared cycle started, e.g. to synchronize with
+   * a master controller. Coordinated lights pick up the change at their next
+   * phase change.
+   * @param reference_ms The reference time in milliseconds.
+   */
+  void set_reference_ms(unsigned long reference_ms);
+};
+
+#endif
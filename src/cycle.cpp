@@ -1,22 +1,56 @@
 #include "cycle.h"
-#include <Arduino.h>
+#include "hal.h"
+#include "instrumentation.h"
 
 Cycle::Cycle()
-    : phases(nullptr), phase_count(0), phase_index(0), repetitions_limit(0),
-      repetitions_count(0), last_time_ms(0), flags(0) {}
+    : phases(nullptr), phase_table(nullptr), packed_table(nullptr),
+      stream(nullptr), current_phase(), queued_table(nullptr),
+      queued_phase_count(0), actuations(nullptr), actuation_count(0),
+      actuation(nullptr), storage(nullptr), storage_capacity(0),
+      phase_count(0), phase_index(0), repetitions_limit(0),
+      repetitions_count(0), last_time_ms(0), timing_mode(TimingMode::RELATIVE),
+      coordination(nullptr), coordination_offset_ms(0), schedule_length_ms(0),
+      sync_index(0), sync_start_ms(0), flags(0) {}
 
-Cycle::~Cycle() { delete[] phases; }
+Cycle::~Cycle() { release_phases(); }
 
 bool Cycle::is_enabled() { return flags & (1 << FLAG_ENABLED); }
 
 Phase *Cycle::get_phase() {
   if (!is_enabled() || phase_index >= phase_count)
     return nullptr;
-  return &phases[phase_index];
+  return &current_phase;
+}
+
+int Cycle::get_phase_index() {
+  if (!is_enabled() || phase_index >= phase_count)
+    return -1;
+  return phase_index;
 }
 
 int Cycle::get_phase_count() { return phase_count; }
 
+unsigned long Cycle::get_repetitions_count() { return repetitions_count; }
+
+unsigned long Cycle::get_phase_start_time() { return last_time_ms; }
+
+bool Cycle::get_next_deadline(unsigned long &deadline_ms) {
+  if (!is_enabled() || phase_count == 0)
+    return false;
+  deadline_ms = last_time_ms + current_phase.duration_ms;
+  return true;
+}
+
+bool Cycle::is_behind(unsigned long now) {
+  if (!is_enabled() || phase_count == 0)
+    return false;
+  return now - last_time_ms >= current_phase.duration_ms;
+}
+
+bool Cycle::is_coordinated() { return coordination != nullptr; }
+
+bool Cycle::has_queued_phases() { return flags & (1 << FLAG_QUEUED); }
+
 bool Cycle::has_phase_changed() {
   bool result = flags & (1 << FLAG_PHASE_CHANGED);
   flags &= ~(1 << FLAG_PHASE_CHANGED);
@@ -35,42 +69,368 @@ bool Cycle::has_reached_repetitions_limit() {
   return result;
 }
 
+bool Cycle::has_read_failed() {
+  bool result = flags & (1 << FLAG_READ_FAILED);
+  flags &= ~(1 << FLAG_READ_FAILED);
+  return result;
+}
+
 void Cycle::set_repetitions_limit(unsigned long repetitions_limit) {
   this->repetitions_limit = repetitions_limit;
 }
 
-void Cycle::set_phases(Phase phases[], int phase_count) {
-  if (phase_count <= 0 || phases == nullptr) {
+void Cycle::set_timing_mode(TimingMode mode) { timing_mode = mode; }
+
+void Cycle::set_coordination(CoordinationClock *clock,
+                             unsigned long offset_ms) {
+  coordination = clock;
+  coordination_offset_ms = offset_ms;
+
+  if (!is_enabled() || phase_count == 0) {
+    return;
+  }
+  if (coordination != nullptr) {
+    sync_to_coordination(hal::millis());
+  } else {
+    load_phase(); // Restore the duration of the phase
+  }
+}
+
+void Cycle::set_actuations(const Actuation actuations[],
+                           int actuation_count) {
+  bool valid = (actuations != nullptr && actuation_count > 0);
+  this->actuations = valid ? actuations : nullptr;
+  this->actuation_count = valid ? actuation_count : 0;
+  find_actuation();
+}
+
+void Cycle::poll_detectors() {
+  for (int i = 0; i < actuation_count; i++) {
+    if (actuations[i].detector != nullptr) {
+      actuations[i].detector->poll();
+    }
+  }
+}
+
+void Cycle::set_storage(Phase *storage, int capacity) {
+  release_phases();
+  phases = nullptr;
+  set_table(nullptr, nullptr, nullptr, 0);
+
+  this->storage = (capacity > 0) ? storage : nullptr;
+  storage_capacity = (this->storage != nullptr) ? capacity : 0;
+}
+
+void Cycle::set_phases(const Phase phases[], int phase_count) {
+  Phase *target = nullptr;
+
+  if (phase_count > 0 && phases != nullptr) {
+    if (storage != nullptr) {
+      // Phases must fit into the storage
+      if (phase_count <= storage_capacity) {
+        target = storage;
+      }
+    } else {
+#ifndef TRAFFIC_LIGHT_NO_HEAP
+      target = new Phase[phase_count];
+#endif
+    }
+  }
+
+  if (target == nullptr) {
     // Disable the cycle if invalid input
-    this->phase_count = 0;
-    delete[] this->phases;
+    release_phases();
     this->phases = nullptr;
+    set_table(nullptr, nullptr, nullptr, 0);
     return;
   }
 
-  // Delete old phases
-  delete[] this->phases;
-
-  // Allocate and copy new phases
-  this->phases = new Phase[phase_count];
+  // Copy new phases, then delete old phases (the input may be the old ones)
   for (int i = 0; i < phase_count; i++) {
-    this->phases[i] = phases[i];
+    target[i] = phases[i];
   }
+  if (target != this->phases) {
+    release_phases();
+  }
+  this->phases = target;
+
+  set_table(target, nullptr, nullptr, phase_count);
+}
 
+void Cycle::bind_phases(const Phase phases[], int phase_count) {
+  release_phases();
+  this->phases = nullptr;
+
+  if (phase_count <= 0 || phases == nullptr) {
+    set_table(nullptr, nullptr, nullptr, 0);
+    return;
+  }
+  set_table(phases, nullptr, nullptr, phase_count);
+}
+
+void Cycle::bind_phases(const PackedPhase phases[], int phase_count,
+                        bool in_flash) {
+  release_phases();
+  this->phases = nullptr;
+
+  if (phase_count <= 0 || phases == nullptr) {
+    set_table(nullptr, nullptr, nullptr, 0);
+    return;
+  }
+  if (in_flash) {
+    flags |= (1 << FLAG_IN_FLASH);
+  } else {
+    flags &= ~(1 << FLAG_IN_FLASH);
+  }
+  set_table(nullptr, phases, nullptr, phase_count);
+}
+
+void Cycle::bind_phases(PhaseStreamBase &stream) {
+  release_phases();
+  this->phases = nullptr;
+  set_table(nullptr, nullptr, &stream, stream.get_phase_count());
+}
+
+void Cycle::queue_phases(const Phase phases[], int phase_count) {
+  if (!is_enabled() || this->phase_count == 0) {
+    bind_phases(phases, phase_count);
+    return;
+  }
+  if (phase_count <= 0 || phases == nullptr) {
+    flags &= ~(1 << FLAG_QUEUED);
+    return;
+  }
+
+  queued_table = phases;
+  queued_phase_count = phase_count;
+  flags |= (1 << FLAG_QUEUED);
+}
+
+bool Cycle::apply_queued_phases() {
+  if (!(flags & (1 << FLAG_QUEUED)))
+    return false;
+
+  flags &= ~((1 << FLAG_QUEUED) | (1 << FLAG_IN_FLASH));
+  release_phases();
+  phases = nullptr;
+  phase_table = queued_table;
+  packed_table = nullptr;
+  stream = nullptr;
+  phase_count = queued_phase_count;
+  reset_sync();
+  return true;
+}
+
+void Cycle::set_table(const Phase *phase_table,
+                      const PackedPhase *packed_table, PhaseStreamBase *stream,
+                      int phase_count) {
+  this->phase_table = phase_table;
+  this->packed_table = packed_table;
+  this->stream = stream;
+  flags &= ~(1 << FLAG_QUEUED);
   this->phase_count = phase_count;
   phase_index = 0;
+  reset_sync();
+  load_phase();
 
   // Reset timing
   if (is_enabled()) {
-    last_time_ms = millis();
+    if (coordination != nullptr && phase_count > 0) {
+      sync_to_coordination(hal::millis());
+    } else {
+      last_time_ms = hal::millis();
+    }
+  }
+}
+
+bool Cycle::read_phase(int index, Phase &phase) {
+  if (phase_table != nullptr) {
+    phase = phase_table[index];
+  } else if (packed_table != nullptr) {
+    unpack_phase(&packed_table[index], flags & (1 << FLAG_IN_FLASH), phase);
+  } else if (stream != nullptr) {
+    return stream->get_phase(index, phase);
+  }
+  return true;
+}
+
+bool Cycle::peek_phase(int index, Phase &phase) {
+  if (stream != nullptr) {
+    return stream->peek_phase(index, phase);
+  }
+  return read_phase(index, phase);
+}
+
+void Cycle::reset_sync() {
+  schedule_length_ms = 0;
+  sync_index = 0;
+  sync_start_ms = 0;
+}
+
+bool Cycle::load_phase() {
+  if (phase_index >= phase_count) {
+    return true;
+  }
+  if (!read_phase(phase_index, current_phase)) {
+    fail_read();
+    return false;
+  }
+  find_actuation();
+  return true;
+}
+
+void Cycle::fail_read() {
+  if (!is_enabled())
+    return; // Read again when the cycle is enabled
+
+  // The phase change did not happen, the cycle stays on its last phase
+  flags &= ~(1 << FLAG_PHASE_CHANGED);
+  flags |= (1 << FLAG_READ_FAILED);
+  disable();
+  reset_sync();
+}
+
+void Cycle::find_actuation() {
+  actuation = nullptr;
+  if (coordination != nullptr)
+    return;
+
+  for (int i = 0; i < actuation_count; i++) {
+    if (actuations[i].phase_index == phase_index) {
+      actuation = &actuations[i];
+      // An old actuation would look recent once the clock wrapped
+      if (actuation->detector != nullptr) {
+        actuation->detector->clear_actuation();
+      }
+      return;
+    }
   }
 }
 
-void Cycle::enable() {
-  flags = (1 << FLAG_ENABLED); // Set enabled, clear all other flags
+bool Cycle::is_phase_skipped() {
+  return actuation != nullptr && actuation->skip_without_demand &&
+         actuation->detector != nullptr && !actuation->detector->has_demand();
+}
+
+void Cycle::extend_phase() {
+  unsigned long actuation_ms;
+  if (actuation->extension_ms == 0 || actuation->detector == nullptr ||
+      !actuation->detector->get_last_actuation(actuation_ms))
+    return;
+
+  // Only actuations during the phase extend it
+  if (!hal::time_reached(actuation_ms, last_time_ms))
+    return;
+
+  unsigned long end_ms =
+      (actuation_ms - last_time_ms) + actuation->extension_ms;
+  if (end_ms > actuation->max_duration_ms) {
+    end_ms = actuation->max_duration_ms;
+  }
+  if (end_ms > current_phase.duration_ms) {
+    current_phase.duration_ms = end_ms;
+  }
+}
+
+bool Cycle::sync_to_coordination(unsigned long now) {
+  unsigned long cycle_length_ms = coordination->get_cycle_length_ms();
+  Phase phase;
+
+  // Without a shared cycle length the cycle is as long as its phases
+  if (cycle_length_ms == 0) {
+    if (schedule_length_ms == 0) {
+      for (int i = 0; i < phase_count; i++) {
+        if (!peek_phase(i, phase)) {
+          fail_read();
+          return false;
+        }
+        schedule_length_ms += phase.duration_ms;
+      }
+    }
+    cycle_length_ms = schedule_length_ms;
+  }
+
+  unsigned long position_ms = coordination->get_position_ms(
+      now, coordination_offset_ms, cycle_length_ms);
+
+  // Find the phase covering the position, searching on from the last one
+  // found, so a stream only reads the phases it has buffered ahead
+  unsigned long start_ms = 0;
+  int index = 0;
+  if (sync_index < phase_count && position_ms >= sync_start_ms) {
+    start_ms = sync_start_ms;
+    index = sync_index;
+  }
+  for (; index < phase_count; index++) {
+    if (!peek_phase(index, phase)) {
+      fail_read();
+      return false;
+    }
+    if (index == phase_count - 1 || position_ms < start_ms + phase.duration_ms)
+      break;
+    start_ms += phase.duration_ms;
+  }
+  sync_index = index;
+  sync_start_ms = start_ms;
+  if (!read_phase(index, phase)) {
+    fail_read();
+    return false;
+  }
+
+  // The last phase fills the cycle, phases past its end are cut
+  unsigned long end_ms = start_ms + phase.duration_ms;
+  if (index == phase_count - 1 || end_ms > cycle_length_ms) {
+    end_ms = cycle_length_ms;
+  }
+
+  phase_index = index;
+  current_phase = phase;
+  current_phase.duration_ms = end_ms - start_ms;
+  last_time_ms = now - (position_ms - start_ms);
+  actuation = nullptr; // Coordinated phases are not actuated
+  return true;
+}
+
+void Cycle::release_phases() {
+#ifndef TRAFFIC_LIGHT_NO_HEAP
+  if (phases != storage) {
+    delete[] phases;
+  }
+#endif
+}
+
+void Cycle::enable() { enable_at(hal::millis()); }
+
+void Cycle::enable_at(unsigned long start_time_ms) {
+  // Set enabled, clear all other flags except the table location
+  apply_queued_phases();
+  flags = (flags & (1 << FLAG_IN_FLASH)) | (1 << FLAG_ENABLED);
   repetitions_count = 0;
   phase_index = 0;
-  last_time_ms = millis();
+
+  if (coordination != nullptr && phase_count > 0) {
+    sync_to_coordination(hal::millis());
+    return;
+  }
+  load_phase();
+  last_time_ms = start_time_ms;
+}
+
+bool Cycle::restore(int phase_index, unsigned long elapsed_ms,
+                    unsigned long repetitions_count) {
+  if (phase_index < 0 || phase_index >= phase_count)
+    return false;
+
+  unsigned long now = hal::millis();
+  enable_at(now);
+  this->repetitions_count = repetitions_count;
+  if (coordination != nullptr)
+    return true;
+
+  this->phase_index = phase_index;
+  load_phase();
+  last_time_ms = now - elapsed_ms;
+  return true;
 }
 
 void Cycle::disable() {
@@ -79,32 +439,96 @@ void Cycle::disable() {
 }
 
 void Cycle::update() {
+  instrumentation::ScopeTimer timer(instrumentation::Stage::CYCLE_UPDATE);
+
   // Clear one-time flags
   flags &= ~((1 << FLAG_PHASE_CHANGED) | (1 << FLAG_FINISHED) |
              (1 << FLAG_REACHED_LIMIT));
 
-  if (!is_enabled() || phases == nullptr || phase_count == 0) {
+  if (!is_enabled() || phase_count == 0) {
     return;
   }
 
-  unsigned long now = millis();
+  if (actuation != nullptr) {
+    extend_phase();
+  }
+
+  unsigned long now = hal::millis();
   unsigned long elapsed = (now - last_time_ms);
 
   // Check if current phase duration has elapsed
-  if (elapsed < phases[phase_index].duration_ms) {
+  if (elapsed < current_phase.duration_ms) {
+    return;
+  }
+  instrumentation::record_lateness(elapsed - current_phase.duration_ms);
+
+  if (coordination != nullptr) {
+    update_coordinated(now);
+    return;
+  }
+
+  switch (timing_mode) {
+  case TimingMode::RELATIVE:
+    last_time_ms = now;
+    advance_phase();
+    break;
+  case TimingMode::ABSOLUTE_REPLAY:
+    // One phase per update, is_behind() tells if more phases are missed
+    last_time_ms += current_phase.duration_ms;
+    advance_phase();
+    break;
+  case TimingMode::ABSOLUTE_SKIP:
+    skip_phases(now);
+    break;
+  }
+}
+
+void Cycle::update_coordinated(unsigned long now) {
+  int previous_index = phase_index;
+  if (!sync_to_coordination(now))
     return;
+  flags |= (1 << FLAG_PHASE_CHANGED);
+
+  // Moving back to an earlier phase starts a new cycle
+  if (phase_index <= previous_index) {
+    if (apply_queued_phases() && !sync_to_coordination(now))
+      return;
+    flags |= (1 << FLAG_FINISHED);
+    repetitions_count++;
+
+    // Check repetitions limit
+    if (repetitions_limit > 0 && repetitions_count >= repetitions_limit) {
+      flags |= (1 << FLAG_REACHED_LIMIT);
+      disable();
+      load_phase();
+    }
+  }
+}
+
+void Cycle::advance_phase() {
+  // The demand of the phase is served once it ends
+  if (actuation != nullptr && actuation->detector != nullptr) {
+    actuation->detector->clear_demand();
   }
 
+  // Skipped phases take no time, at most one cycle is run through
+  step_phase();
+  for (int i = 1; i < phase_count && is_enabled() && is_phase_skipped(); i++) {
+    step_phase();
+  }
+}
+
+void Cycle::step_phase() {
   // Phase change logic
   flags |= (1 << FLAG_PHASE_CHANGED);
   phase_index++;
-  last_time_ms = now;
 
   // Check if cycle finished
   if (phase_index >= phase_count) {
     flags |= (1 << FLAG_FINISHED);
     phase_index = 0;
     repetitions_count++;
+    apply_queued_phases();
 
     // Check repetitions limit
     if (repetitions_limit > 0 && repetitions_count >= repetitions_limit) {
@@ -112,4 +536,43 @@ void Cycle::update() {
       disable();
     }
   }
+
+  load_phase();
+}
+
+void Cycle::skip_phases(unsigned long now) {
+  int start_index = phase_index;
+  unsigned long cycle_duration_ms = 0;
+
+  do {
+    bool queued = has_queued_phases();
+    last_time_ms += current_phase.duration_ms;
+    cycle_duration_ms += current_phase.duration_ms;
+    advance_phase();
+    if (!is_enabled()) {
+      return; // Repetitions limit reached or phase not read
+    }
+
+    if (queued && !has_queued_phases()) {
+      // Switched phases, measure the new cycle from its start
+      start_index = phase_index;
+      cycle_duration_ms = 0;
+      continue;
+    }
+
+    if (phase_index == start_index) {
+      if (cycle_duration_ms == 0) {
+        return; // Phases without duration never catch up
+      }
+
+      // Skip further complete cycles at once
+      unsigned long cycles = (now - last_time_ms) / cycle_duration_ms;
+      if (repetitions_limit > 0 &&
+          cycles >= repetitions_limit - repetitions_count) {
+        cycles = repetitions_limit - repetitions_count - 1;
+      }
+      last_time_ms += cycles * cycle_duration_ms;
+      repetitions_count += cycles;
+    }
+  } while (now - last_time_ms >= current_phase.duration_ms);
 }
\ No newline at end of file
@@ -1,7 +1,11 @@
 #ifndef CYCLE_H
 #define CYCLE_H
 
+#include "coordination_clock.h"
+#include "detector.h"
 #include "phase.h"
+#include "phase_source.h"
+#include "timing_mode.h"
 #include <stdint.h>
 
 class Cycle {
@@ -11,19 +15,147 @@ private:
   static constexpr uint8_t FLAG_PHASE_CHANGED = 1;
   static constexpr uint8_t FLAG_FINISHED = 2;
   static constexpr uint8_t FLAG_REACHED_LIMIT = 3;
+  static constexpr uint8_t FLAG_IN_FLASH = 4;
+  static constexpr uint8_t FLAG_QUEUED = 5;
+  static constexpr uint8_t FLAG_READ_FAILED = 6;
 
-  Phase *phases;
+  Phase *phases; // Phases copied by set_phases(), nullptr if bound
+  const Phase *phase_table;        // Phases read by the cycle
+  const PackedPhase *packed_table; // Packed phases read by the cycle
+  PhaseStreamBase *stream;         // Streamed phases read by the cycle
+  Phase current_phase;             // Copy of the phase at phase_index
+  const Phase *queued_table; // Phases to switch to at the end of the cycle
+  int queued_phase_count;
+  const Actuation *actuations; // Actuated phases, nullptr if fixed time
+  int actuation_count;
+  const Actuation *actuation; // Actuation of the current phase or nullptr
+  Phase *storage; // Caller provided memory for the phases, nullptr for heap
+  int storage_capacity;
   int phase_count;
   int phase_index;
   unsigned long repetitions_limit;
   unsigned long repetitions_count;
-  unsigned long last_time_ms;
+  unsigned long last_time_ms; // Start of the current phase
+  TimingMode timing_mode;
+  CoordinationClock *coordination; // nullptr if not coordinated
+  unsigned long coordination_offset_ms;
+  unsigned long schedule_length_ms; // Sum of the durations, 0 if not known
+  int sync_index;                   // Phase whose start is sync_start_ms
+  unsigned long sync_start_ms;      // Start of sync_index within the cycle
   uint8_t flags; // Bitfield for boolean flags
 
   // Disable copy constructor and assignment
   Cycle(const Cycle &) = delete;
   Cycle &operator=(const Cycle &) = delete;
 
+  /**
+   * Frees the phases if they were allocated on the heap.
+   */
+  void release_phases();
+
+  /**
+   * Makes a table the phases are read from and restarts the cycle.
+   * @param phase_table Array of phases or nullptr.
+   * @param packed_table Array of packed phases or nullptr.
+   * @param stream Stream of phases or nullptr.
+   * @param phase_count Number of phases in the array.
+   */
+  void set_table(const Phase *phase_table, const PackedPhase *packed_table,
+                 PhaseStreamBase *stream, int phase_count);
+
+  /**
+   * Switches to the queued phases without touching the phase index and
+   * timing.
+   * @return True if there were queued phases, false otherwise.
+   */
+  bool apply_queued_phases();
+
+  /**
+   * Reads a phase from the table.
+   * @param index The index of the phase.
+   * @param phase Set to the phase, unchanged if the read failed.
+   * @return True if the phase was read, false if a stream failed.
+   */
+  bool read_phase(int index, Phase &phase);
+
+  /**
+   * Reads a phase from the table without dropping buffered phases of a
+   * stream.
+   * @param index The index of the phase.
+   * @param phase Set to the phase, unchanged if the read failed.
+   * @return True if the phase was read, false if a stream failed.
+   */
+  bool peek_phase(int index, Phase &phase);
+
+  /**
+   * Forgets the schedule length and phase start found by
+   * sync_to_coordination(), called when the phases change.
+   */
+  void reset_sync();
+
+  /**
+   * Reads the phase at phase_index into current_phase.
+   * @return True if the phase was read, false if the cycle was stopped by
+   * fail_read().
+   */
+  bool load_phase();
+
+  /**
+   * Stops a running cycle whose phase could not be read, so a stale phase
+   * is never shown, and sets the read failed flag.
+   */
+  void fail_read();
+
+  /**
+   * Moves to the phase at the current position of the coordination clock.
+   * The duration of current_phase is shortened or extended, so the phase
+   * ends where the next one starts within the coordinated cycle.
+   * @param now The current time in milliseconds.
+   * @return True if the phase was read, false if the cycle was stopped by
+   * fail_read().
+   */
+  bool sync_to_coordination(unsigned long now);
+
+  /**
+   * Moves to the phase given by the coordination clock and sets the event
+   * flags.
+   * @param now The current time in milliseconds.
+   */
+  void update_coordinated(unsigned long now);
+
+  /**
+   * Moves to the next phase and sets the event flags.
+   */
+  void step_phase();
+
+  /**
+   * Moves to the next phase that is not skipped and sets the event flags.
+   */
+  void advance_phase();
+
+  /**
+   * Finds the actuation of the phase at phase_index and clears the last
+   * actuation of its detector.
+   */
+  void find_actuation();
+
+  /**
+   * Checks if the current phase is skipped for lack of demand.
+   * @return True if the phase is skipped, false otherwise.
+   */
+  bool is_phase_skipped();
+
+  /**
+   * Extends the current phase by the actuations of its detector.
+   */
+  void extend_phase();
+
+  /**
+   * Moves to the phase that should be shown now, skipping missed phases.
+   * @param now The current time in milliseconds.
+   */
+  void skip_phases(unsigned long now);
+
 public:
   Cycle();
   ~Cycle();
@@ -36,16 +168,62 @@ public:
 
   /**
    * Gets the current phase.
-   * @return Pointer to the current phase.
+   * @return Pointer to a copy of the current phase, nullptr if the cycle is
+   * not running.
    */
   Phase *get_phase();
 
+  /**
+   * Gets the index of the current phase.
+   * @return Index of the phase, -1 if the cycle is not running.
+   */
+  int get_phase_index();
+
   /**
    * Gets the number of phases in the cycle.
    * @return Number of phases.
    */
   int get_phase_count();
 
+  /**
+   * Gets the number of completed repetitions of the cycle.
+   * @return The number of repetitions.
+   */
+  unsigned long get_repetitions_count();
+
+  /**
+   * Gets the point in time the current phase started.
+   * @return The start of the phase in milliseconds.
+   */
+  unsigned long get_phase_start_time();
+
+  /**
+   * Gets the point in time the current phase ends.
+   * @param deadline_ms Set to the end of the phase in milliseconds.
+   * @return True if the cycle is running, false if there is no deadline.
+   */
+  bool get_next_deadline(unsigned long &deadline_ms);
+
+  /**
+   * Checks if the current phase has already ended, i.e. update() has to be
+   * called again to replay missed phases.
+   * @param now The current time in milliseconds.
+   * @return True if the cycle is running behind, false otherwise.
+   */
+  bool is_behind(unsigned long now);
+
+  /**
+   * Checks if the cycle follows a coordination clock.
+   * @return True if the cycle is coordinated, false otherwise.
+   */
+  bool is_coordinated();
+
+  /**
+   * Checks if phases are queued to be switched to at the end of the cycle.
+   * @return True if phases are queued, false otherwise.
+   */
+  bool has_queued_phases();
+
   /**
    * Checks if the phase has changed since the last update.
    * @return True if the phase has changed, false otherwise.
@@ -64,18 +242,108 @@ public:
    */
   bool has_reached_repetitions_limit();
 
+  /**
+   * Checks if the cycle stopped because a phase could not be read from its
+   * stream, e.g. a removed SD card, and resets the flag.
+   * @return True if a read failed, false otherwise.
+   */
+  bool has_read_failed();
+
   /**
    * Sets the limit for cycle repetitions.
    * @param repetitions_limit The number of repetitions allowed.
    */
   void set_repetitions_limit(unsigned long repetitions_limit);
 
+  /**
+   * Sets how phases are scheduled when update() runs late.
+   * @param mode The timing mode, RELATIVE by default.
+   */
+  void set_timing_mode(TimingMode mode);
+
+  /**
+   * Ties the cycle to a coordination clock.
+   * The phase is computed from the position within the coordinated cycle:
+   * the cycle starts offset_ms after each cycle of the clock. If the phases
+   * are shorter than the cycle, the last phase is extended, if they are
+   * longer, the phases past the end of the cycle are cut. The timing mode is
+   * ignored while the cycle is coordinated.
+   * @param clock The coordination clock, must stay valid while it is used.
+   * nullptr to time the phases one after another again.
+   * @param offset_ms The offset of the cycle in milliseconds.
+   */
+  void set_coordination(CoordinationClock *clock, unsigned long offset_ms);
+
+  /**
+   * Makes phases actuated by detectors: they last from their duration up to
+   * a maximum while actuations keep coming, and can be skipped if nobody is
+   * waiting. Ignored while the cycle is coordinated.
+   * @param actuations The actuated phases, must stay valid while they are
+   * used. nullptr for fixed time phases only.
+   * @param actuation_count The number of actuated phases.
+   */
+  void set_actuations(const Actuation actuations[], int actuation_count);
+
+  /**
+   * Reads the detectors of the actuated phases that have a pin. Called by
+   * TrafficLight::update() before update(), call it more often to catch
+   * short actuations.
+   */
+  void poll_detectors();
+
+  /**
+   * Sets the memory the phases are copied to instead of the heap.
+   * Removes the current phases.
+   * @param storage Array for the phases, must stay valid while the cycle is
+   * used. nullptr to use the heap again.
+   * @param capacity Number of phases fitting into the array.
+   */
+  void set_storage(Phase *storage, int capacity);
+
   /**
    * Sets the phases for the cycle.
+   * The phases are copied to the storage set with set_storage() or to the
+   * heap. If TRAFFIC_LIGHT_NO_HEAP is defined, phases are only accepted if a
+   * storage is set.
    * @param phases Array of phases.
    * @param phase_count Number of phases in the array.
    */
-  void set_phases(Phase phases[], int phase_count);
+  void set_phases(const Phase phases[], int phase_count);
+
+  /**
+   * Uses phases without copying them.
+   * @param phases Array of phases, must stay valid while it is used.
+   * @param phase_count Number of phases in the array.
+   */
+  void bind_phases(const Phase phases[], int phase_count);
+
+  /**
+   * Uses packed phases without copying them.
+   * @param phases Array of packed phases, must stay valid while it is used.
+   * @param phase_count Number of phases in the array.
+   * @param in_flash True if the array is stored in flash (PROGMEM).
+   */
+  void bind_phases(const PackedPhase phases[], int phase_count,
+                   bool in_flash = false);
+
+  /**
+   * Streams the phases from external storage instead of holding them in RAM.
+   * Only the phases buffered by the stream take memory, so the schedule can
+   * be of any length. Call the stream's refill() regularly. A coordinated
+   * cycle without a shared cycle length reads through the whole schedule
+   * once to sum up its length.
+   * @param stream The stream, must stay valid while it is used.
+   */
+  void bind_phases(PhaseStreamBase &stream);
+
+  /**
+   * Switches to other phases when the current cycle ends, so the running
+   * cycle is completed and the timing continues seamlessly. Nothing is
+   * copied or allocated. A disabled cycle switches right away.
+   * @param phases Array of phases, must stay valid while it is used.
+   * @param phase_count Number of phases in the array.
+   */
+  void queue_phases(const Phase phases[], int phase_count);
 
   /**
    * Enables the cycle.
@@ -84,6 +352,28 @@ public:
    */
   void enable();
 
+  /**
+   * Enables the cycle as if it was enabled at another time.
+   * Phases that would have ended by now are caught up on the next update()
+   * unless the timing mode is RELATIVE. A coordinated cycle ignores the start
+   * time and starts with the phase given by its coordination clock.
+   * @param start_time_ms The start time of the first phase in milliseconds.
+   */
+  void enable_at(unsigned long start_time_ms);
+
+  /**
+   * Enables the cycle in a saved state, e.g. after a reset.
+   * A coordinated cycle only restores the repetitions and takes its phase
+   * from the coordination clock.
+   * @param phase_index The index of the phase to continue with.
+   * @param elapsed_ms The time the phase has already been shown.
+   * @param repetitions_count The number of completed repetitions.
+   * @return True if the state was restored, false if the phase index is out
+   * of range.
+   */
+  bool restore(int phase_index, unsigned long elapsed_ms,
+               unsigned long repetitions_count);
+
   /**
    * Disables the cycle.
    */
@@ -95,4 +385,17 @@ public:
   void update();
 };
 
+/**
+ * Cycle with storage for a fixed number of phases, never uses the heap.
+ */
+template <int CAPACITY> class StaticCycle : public Cycle {
+  static_assert(CAPACITY > 0, "Capacity must be positive");
+
+private:
+  Phase phase_storage[CAPACITY];
+
+public:
+  StaticCycle() { set_storage(phase_storage, CAPACITY); }
+};
+
 #endif
\ No newline at end of file
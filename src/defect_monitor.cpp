@@ -0,0 +1,119 @@
+#include "defect_monitor.h"
+#include "hal.h"
+
+DefectMonitorBase::DefectMonitorBase(int *pins, uint8_t *counters,
+                                     uint8_t channel_count)
+    : pins(pins), counters(counters), defect_mask(0),
+      channel_count(channel_count), next_channel(0),
+      filter_samples(DEFAULT_FILTER_SAMPLES), auto_recovery_enabled(false),
+      threshold(DEFAULT_THRESHOLD),
+      sample_interval_ms(DEFAULT_SAMPLE_INTERVAL_MS), last_sample_time_ms(0) {
+  for (int i = 0; i < channel_count; i++) {
+    pins[i] = INVALID_PIN;
+    counters[i] = 0;
+  }
+}
+
+bool DefectMonitorBase::has_pins() {
+  for (int i = 0; i < channel_count; i++) {
+    if (pins[i] != INVALID_PIN)
+      return true;
+  }
+  return false;
+}
+
+bool DefectMonitorBase::is_intact(int channel) {
+  if (channel < 0 || channel >= channel_count)
+    return true;
+  return !(defect_mask & (1UL << channel));
+}
+
+uint32_t DefectMonitorBase::get_defect_mask() { return defect_mask; }
+
+bool DefectMonitorBase::get_next_deadline(unsigned long &deadline_ms) {
+  if (!has_pins())
+    return false;
+  deadline_ms = last_sample_time_ms + sample_interval_ms;
+  return true;
+}
+
+void DefectMonitorBase::set_pin(int channel, int pin) {
+  if (channel < 0 || channel >= channel_count) {
+    return; // Invalid channel
+  }
+
+  pins[channel] = pin;
+  counters[channel] = 0;
+  defect_mask &= ~(1UL << channel);
+
+  // Configure new pin if valid
+  if (pin != INVALID_PIN) {
+    hal::pin_mode(pin, PinMode::INPUT_MODE);
+  }
+}
+
+void DefectMonitorBase::set_sample_interval(unsigned long interval_ms) {
+  sample_interval_ms = interval_ms;
+}
+
+void DefectMonitorBase::set_filter_samples(uint8_t samples) {
+  filter_samples = (samples > 0) ? samples : 1;
+}
+
+void DefectMonitorBase::set_threshold(int threshold) {
+  this->threshold = threshold;
+}
+
+void DefectMonitorBase::set_auto_recovery(bool enabled) {
+  auto_recovery_enabled = enabled;
+}
+
+void DefectMonitorBase::restore(uint32_t defect_mask) {
+  uint32_t channels_mask =
+      (channel_count < 32) ? (1UL << channel_count) - 1 : 0xFFFFFFFFUL;
+  this->defect_mask = defect_mask & channels_mask;
+  for (int i = 0; i < channel_count; i++) {
+    counters[i] = 0;
+  }
+}
+
+int DefectMonitorBase::update(uint32_t lit_mask) {
+  unsigned long now = hal::millis();
+  unsigned long elapsed = (now - last_sample_time_ms);
+
+  // Throttle the sample rate
+  if (elapsed < sample_interval_ms) {
+    return -1;
+  }
+  last_sample_time_ms = now;
+
+  // Find the next channel with a test pin whose light is on
+  int channel = -1;
+  for (int i = 0; i < channel_count; i++) {
+    int candidate = (next_channel + i) % channel_count;
+    if (pins[candidate] != INVALID_PIN && (lit_mask & (1UL << candidate))) {
+      channel = candidate;
+      break;
+    }
+  }
+  if (channel < 0) {
+    return -1;
+  }
+  next_channel = (channel + 1) % channel_count;
+
+  bool is_defect = hal::analog_read(pins[channel]) > threshold;
+  bool was_defect = defect_mask & (1UL << channel);
+
+  // Readings agreeing with the current state reset the filter
+  if (is_defect == was_defect || (!is_defect && !auto_recovery_enabled)) {
+    counters[channel] = 0;
+    return -1;
+  }
+  if (++counters[channel] < filter_samples) {
+    return -1;
+  }
+
+  counters[channel] = 0;
+  defect_mask ^= (1UL << channel);
+  return channel;
+}
@@ -0,0 +1,133 @@
+#ifndef DEFECT_MONITOR_H
+#define DEFECT_MONITOR_H
+
+#include <stdint.h>
+
+/**
+ * Detects defect lights by reading one test pin per sample tick.
+ * The channels are sampled round-robin, so a tick costs at most one analog
+ * read. A channel changes its state only after a number of consecutive
+ * samples agree, which filters out single noisy readings.
+ *
+ * Use the DefectMonitor template to get a monitor with its storage
+ */
+class DefectMonitorBase {
+public:
+  static constexpr int MAX_CHANNELS = 32;
+  static constexpr int INVALID_PIN = -1;
+  static constexpr int DEFAULT_THRESHOLD = 1000;
+  static constexpr unsigned long DEFAULT_SAMPLE_INTERVAL_MS = 33;
+  static constexpr uint8_t DEFAULT_FILTER_SAMPLES = 3;
+
+private:
+  int *pins;
+  uint8_t *counters;    // Consecutive samples disagreeing
+  uint32_t defect_mask; // Bit i set if channel i is defect
+  uint8_t channel_count;
+  uint8_t next_channel;
+  uint8_t filter_samples;
+  bool auto_recovery_enabled;
+  int threshold;
+  unsigned long sample_interval_ms;
+  unsigned long last_sample_time_ms;
+
+  // Disable copy constructor and assignment
+  DefectMonitorBase(const DefectMonitorBase &) = delete;
+  DefectMonitorBase &operator=(const DefectMonitorBase &) = delete;
+
+public:
+  /**
+   * Checks if any test pin is configured.
+   * @return True if at least one channel has a test pin, false otherwise.
+   */
+  bool has_pins();
+
+  /**
+   * Checks if the light of a channel is intact.
+   * @param channel The index of the channel.
+   * @return True if the light is intact or unknown, false if it is defect.
+   */
+  bool is_intact(int channel);
+
+  /**
+   * Gets the channels detected as defect.
+   * @return Bit i set if channel i is defect.
+   */
+  uint32_t get_defect_mask();
+
+  /**
+   * Gets the point in time the next sample is due.
+   * @param deadline_ms Set to the deadline in milliseconds.
+   * @return True if any test pin is configured, false otherwise.
+   */
+  bool get_next_deadline(unsigned long &deadline_ms);
+
+  /**
+   * Sets the test pin of a channel and configures it as input.
+   * Resets the state of the channel to intact.
+   * @param channel The index of the channel.
+   * @param pin The test pin, -1 to disable.
+   */
+  void set_pin(int channel, int pin);
+
+  /**
+   * Sets the time between two samples. Each sample reads one channel, so
+   * every channel is read once per interval times the number of channels.
+   * @param interval_ms The sample interval in milliseconds.
+   */
+  void set_sample_interval(unsigned long interval_ms);
+
+  /**
+   * Sets the number of consecutive samples needed to change a channel's
+   * state.
+   * @param samples The number of samples, at least 1.
+   */
+  void set_filter_samples(uint8_t samples);
+
+  /**
+   * Sets the reading above which a light counts as defect.
+   * @param threshold The analog reading.
+   */
+  void set_threshold(int threshold);
+
+  /**
+   * Sets if defect lights become intact again when their readings recover.
+   * @param enabled True to enable auto recovery, false to disable.
+   */
+  void set_auto_recovery(bool enabled);
+
+  /**
+   * Restores saved defect states, e.g. after a reset. The filter starts over
+   * from the restored states.
+   * @param defect_mask Bit i set if channel i is defect.
+   */
+  void restore(uint32_t defect_mask);
+
+  /**
+   * Samples the next channel if the sample interval has elapsed.
+   * Only lights that are on are tested.
+   * @param lit_mask Bit i set if light i is supposed to be on.
+   * @return The channel whose state changed, -1 if none changed.
+   */
+  int update(uint32_t lit_mask);
+
+protected:
+  DefectMonitorBase(int *pins, uint8_t *counters, uint8_t channel_count);
+};
+
+/**
+ * Defect monitor with storage for a fixed number of channels
+ */
+template <int CHANNELS = 3> class DefectMonitor : public DefectMonitorBase {
+  static_assert(CHANNELS > 0 && CHANNELS <= MAX_CHANNELS,
+                "Channels must be between 1 and 32");
+
+private:
+  int pins[CHANNELS];
+  uint8_t counters[CHANNELS];
+
+public:
+  DefectMonitor() : DefectMonitorBase(pins, counters, CHANNELS) {}
+};
+
+#endif
@@ -0,0 +1,50 @@
+#include "detector.h"
+#include "hal.h"
+
+Detector::Detector()
+    : last_actuation_ms(0), actuation_count(0), actuated(false),
+      demand(false), active_low(false), pin(INVALID_PIN) {}
+
+bool Detector::has_demand() { return demand; }
+
+bool Detector::get_last_actuation(unsigned long &time_ms) {
+  if (!actuated)
+    return false;
+
+  // trigger() may run in between, read until the count stays the same
+  uint8_t count;
+  do {
+    count = actuation_count;
+    time_ms = last_actuation_ms;
+  } while (count != actuation_count);
+  return true;
+}
+
+void Detector::set_pin(int pin, bool active_low) {
+  this->pin = pin;
+  this->active_low = active_low;
+
+  if (pin != INVALID_PIN) {
+    hal::pin_mode(pin, active_low ? PinMode::INPUT_PULLUP_MODE
+                                  : PinMode::INPUT_MODE);
+  }
+}
+
+void Detector::trigger() {
+  last_actuation_ms = hal::millis();
+  actuation_count = actuation_count + 1;
+  actuated = true;
+  demand = true;
+}
+
+void Detector::poll() {
+  if (pin == INVALID_PIN)
+    return;
+  if (hal::digital_read(pin) != active_low) {
+    trigger();
+  }
+}
+
+void Detector::clear_demand() { demand = false; }
+
+void Detector::clear_actuation() { actuated = false; }
\ No newline at end of file
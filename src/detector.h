@@ -0,0 +1,93 @@
+#ifndef DETECTOR_H
+#define DETECTOR_H
+
+#include <stdint.h>
+
+/**
+ * Vehicle or pedestrian detector, e.g. a pushbutton or an induction loop.
+ * Actuations are either reported with trigger(), which is safe to call from
+ * an interrupt, or read from a digital pin by poll(). A detector registers
+ * demand for its phase and extends the phase while actuations keep coming.
+ */
+class Detector {
+public:
+  static constexpr int INVALID_PIN = -1;
+
+private:
+  volatile unsigned long last_actuation_ms;
+  volatile uint8_t actuation_count; // Changes with every trigger(), may wrap
+  volatile bool actuated;           // Triggered since clear_actuation()
+  volatile bool demand;             // Triggered since clear_demand()
+  bool active_low;
+  int pin;
+
+  // Disable copy constructor and assignment
+  Detector(const Detector &) = delete;
+  Detector &operator=(const Detector &) = delete;
+
+public:
+  Detector();
+  ~Detector() = default;
+
+  /**
+   * Checks if the detector was actuated since its demand was last served.
+   * @return True if there is demand, false otherwise.
+   */
+  bool has_demand();
+
+  /**
+   * Gets the time of the last actuation.
+   * @param time_ms Set to the time of the actuation in milliseconds.
+   * @return True if the detector was actuated since clear_actuation(), false
+   * otherwise.
+   */
+  bool get_last_actuation(unsigned long &time_ms);
+
+  /**
+   * Sets a digital pin to read by poll() and configures it as input.
+   * @param pin The pin, -1 to only use trigger().
+   * @param active_low True if the detector pulls the pin LOW when actuated,
+   * e.g. a pushbutton to ground. The internal pull-up is enabled then.
+   */
+  void set_pin(int pin, bool active_low = false);
+
+  /**
+   * Reports an actuation. Safe to call from an interrupt handler, e.g. one
+   * attached with attachInterrupt().
+   */
+  void trigger();
+
+  /**
+   * Reads the pin and reports an actuation while it is active, so a vehicle
+   * standing on a loop keeps extending its phase.
+   */
+  void poll();
+
+  /**
+   * Marks the demand as served, called when the phase of the detector ends.
+   */
+  void clear_demand();
+
+  /**
+   * Forgets the last actuation, called when the phase of the detector
+   * starts, so only actuations during the phase extend it. The demand is
+   * kept.
+   */
+  void clear_actuation();
+};
+
+/**
+ * Makes a phase of a cycle actuated by a detector.
+ * The duration of the phase is its minimum green. Each actuation extends
+ * the phase to extension_ms after the actuation, up to max_duration_ms, so
+ * the phase gaps out once no actuation arrives for extension_ms.
+ */
+struct Actuation {
+  int phase_index;
+  Detector *detector;
+  unsigned long extension_ms;    // Green after each actuation, 0 for none
+  unsigned long max_duration_ms; // Longest duration including extensions
+  bool skip_without_demand;      // Skip the phase if nobody is waiting
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,62 @@
+#include "event_queue.h"
+
+EventQueueBase::EventQueueBase(QueuedEvent *buffer, uint8_t capacity)
+    : buffer(buffer), mask(capacity - 1), head(0), tail(0),
+      overflow_count(0) {}
+
+bool EventQueueBase::push(EventManager *manager,
+                          const EventPayload &payload) {
+  uint8_t current_head = head;
+  uint8_t current_tail = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+
+  if (static_cast<uint8_t>(current_head - current_tail) > mask) {
+    overflow_count = overflow_count + 1;
+    return false;
+  }
+
+  QueuedEvent &event = buffer[current_head & mask];
+  event.manager = manager;
+  event.payload = payload;
+
+  // Publish the event only after it is completely written
+  __atomic_store_n(&head, static_cast<uint8_t>(current_head + 1),
+                   __ATOMIC_RELEASE);
+  return true;
+}
+
+int EventQueueBase::dispatch_events(int max_count) {
+  int count = 0;
+
+  while (max_count == 0 || count < max_count) {
+    uint8_t current_tail = tail;
+    if (current_tail == __atomic_load_n(&head, __ATOMIC_ACQUIRE))
+      break;
+
+    // Copy the event, so its slot can be reused while it is delivered
+    QueuedEvent event = buffer[current_tail & mask];
+    __atomic_store_n(&tail, static_cast<uint8_t>(current_tail + 1),
+                     __ATOMIC_RELEASE);
+
+    event.manager->dispatch(event.payload);
+    count++;
+  }
+
+  return count;
+}
+
+int EventQueueBase::get_size() {
+  return static_cast<uint8_t>(__atomic_load_n(&head, __ATOMIC_ACQUIRE) -
+                              __atomic_load_n(&tail, __ATOMIC_ACQUIRE));
+}
+
+int EventQueueBase::get_capacity() { return mask + 1; }
+
+unsigned long EventQueueBase::get_overflow_count() {
+  // The producer may update the counter while it is read, read it until two
+  // reads agree
+  unsigned long count;
+  do {
+    count = overflow_count;
+  } while (count != overflow_count);
+  return count;
+}
@@ -0,0 +1,89 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include "events.h"
+#include <stdint.h>
+
+/**
+ * An event waiting in an EventQueue
+ */
+struct QueuedEvent {
+  EventManager *manager;
+  EventPayload payload;
+};
+
+/**
+ * Fixed size lock-free ring buffer deferring events
+ * Events are pushed by one producer (e.g. update() or a timer interrupt) and
+ * delivered by one consumer calling dispatch_events(), so slow callbacks do
+ * not delay the producer. Events not fitting into the queue are dropped and
+ * counted.
+ *
+ * Use the EventQueue template to get a queue with its storage
+ */
+class EventQueueBase {
+public:
+  /**
+   * Adds an event to the queue, called by the producer
+   * @param manager The event manager delivering the event
+   * @param payload The data of the event
+   * @return True if the event was queued, false if the queue is full
+   */
+  bool push(EventManager *manager, const EventPayload &payload);
+
+  /**
+   * Delivers queued events to their listeners, called by the consumer
+   * @param max_count The maximum number of events to deliver, 0 for all
+   * @return The number of delivered events
+   */
+  int dispatch_events(int max_count = 0);
+
+  /**
+   * Gets the number of queued events
+   * @return The number of events
+   */
+  int get_size();
+
+  /**
+   * Gets the maximum number of queued events
+   * @return The capacity of the queue
+   */
+  int get_capacity();
+
+  /**
+   * Gets the number of events dropped because the queue was full
+   * @return The number of dropped events
+   */
+  unsigned long get_overflow_count();
+
+protected:
+  EventQueueBase(QueuedEvent *buffer, uint8_t capacity);
+
+private:
+  QueuedEvent *buffer;
+  uint8_t mask;
+  uint8_t head; // Next slot to write, only written by the producer
+  uint8_t tail; // Next slot to read, only written by the consumer
+  volatile unsigned long overflow_count;
+
+  // Disable copy constructor and assignment
+  EventQueueBase(const EventQueueBase &) = delete;
+  EventQueueBase &operator=(const EventQueueBase &) = delete;
+};
+
+/**
+ * Event queue with storage for a fixed number of events
+ */
+template <uint8_t CAPACITY> class EventQueue : public EventQueueBase {
+  static_assert(CAPACITY > 0 && CAPACITY <= 128 &&
+                    (CAPACITY & (CAPACITY - 1)) == 0,
+                "Capacity must be a power of two of at most 128");
+
+private:
+  QueuedEvent events[CAPACITY];
+
+public:
+  EventQueue() : EventQueueBase(events, CAPACITY) {}
+};
+
+#endif
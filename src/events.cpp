@@ -1,16 +1,140 @@
 #include "events.h"
+#include "event_queue.h"
+
+EventManager::~EventManager() {
+  // Unlink the listeners, so they can be subscribed elsewhere
+  for (Event &event : events) {
+    while (event.listeners != nullptr) {
+      remove(&event.listeners, *event.listeners);
+    }
+  }
+  while (all_listeners != nullptr) {
+    remove(&all_listeners, *all_listeners);
+  }
+}
 
 void EventManager::connect(EventName name, void (*callback)()) {
   events[static_cast<int>(name)].callback = callback;
+  update_subscription(name);
 }
 
 void EventManager::disconnect(EventName name) {
   events[static_cast<int>(name)].callback = nullptr;
+  update_subscription(name);
+}
+
+void EventManager::subscribe(EventListener &listener) {
+  if (listener.name >= EventName::COUNT)
+    return; // Listener without event
+
+  append(&events[static_cast<int>(listener.name)].listeners, listener);
+  update_subscription(listener.name);
+}
+
+void EventManager::subscribe_all(EventListener &listener) {
+  append(&all_listeners, listener);
+  for (int i = 0; i < static_cast<int>(EventName::COUNT); i++) {
+    update_subscription(static_cast<EventName>(i));
+  }
+}
+
+void EventManager::unsubscribe(EventListener &listener) {
+  if (listener.manager != this)
+    return; // Subscribed elsewhere
+
+  if (remove(&all_listeners, listener)) {
+    for (int i = 0; i < static_cast<int>(EventName::COUNT); i++) {
+      update_subscription(static_cast<EventName>(i));
+    }
+  } else if (listener.name < EventName::COUNT) {
+    remove(&events[static_cast<int>(listener.name)].listeners, listener);
+    update_subscription(listener.name);
+  }
+}
+
+void EventManager::append(EventListener **link, EventListener &listener) {
+  if (listener.manager == this)
+    return; // Subscribing twice would create a loop
+
+  // Relinking would cut off the listeners after it in the other manager
+  if (listener.manager != nullptr) {
+    listener.manager->unsubscribe(listener);
+  }
+
+  // Append, so listeners are called in the order they subscribed
+  while (*link != nullptr) {
+    link = &(*link)->next;
+  }
+
+  listener.next = nullptr;
+  listener.manager = this;
+  *link = &listener;
+}
+
+bool EventManager::remove(EventListener **link, EventListener &listener) {
+  for (; *link != nullptr; link = &(*link)->next) {
+    if (*link == &listener) {
+      *link = listener.next;
+      listener.next = nullptr;
+      listener.manager = nullptr;
+      return true;
+    }
+  }
+  return false;
 }
 
 void EventManager::emit(EventName name) {
-  void (*callback)() = events[static_cast<int>(name)].callback;
+  if (!is_subscribed(name))
+    return;
+
+  EventPayload payload = {name, nullptr, -1, -1, -1, 0};
+  emit(payload);
+}
+
+void EventManager::emit(const EventPayload &payload) {
+  if (!is_subscribed(payload.name))
+    return;
+
+  if (queue != nullptr) {
+    queue->push(this, payload);
+    return;
+  }
+
+  dispatch(payload);
+}
+
+void EventManager::dispatch(const EventPayload &payload) {
+  Event &event = events[static_cast<int>(payload.name)];
+  void (*callback)() = event.callback;
   if (callback != nullptr) {
     callback();
   }
+
+  EventListener *listener = event.listeners;
+  while (listener != nullptr) {
+    EventListener *next = listener->next; // Listener may unsubscribe itself
+    listener->callback(listener->context, payload);
+    listener = next;
+  }
+
+  listener = all_listeners;
+  while (listener != nullptr) {
+    EventListener *next = listener->next;
+    listener->callback(listener->context, payload);
+    listener = next;
+  }
+}
+
+void EventManager::set_queue(EventQueueBase *queue) { this->queue = queue; }
+
+void EventManager::update_subscription(EventName name) {
+  Event &event = events[static_cast<int>(name)];
+  uint32_t bit = 1UL << static_cast<int>(name);
+
+  if (event.callback != nullptr || event.listeners != nullptr ||
+      all_listeners != nullptr) {
+    subscriptions |= bit;
+  } else {
+    subscriptions &= ~bit;
+  }
 }
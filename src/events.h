@@ -1,6 +1,8 @@
 #ifndef EVENTS_H
 #define EVENTS_H
 
+#include <stdint.h>
+
 #define EVENT_LIST                                                             \
   EVENT(RED_LIGHT_DEFECT)                                                      \
   EVENT(YELLOW_LIGHT_DEFECT)                                                   \
@@ -13,7 +15,11 @@
   EVENT(CYCLE_REACHED_REPETITIONS_LIMIT)                                       \
   EVENT(ACTIVITY_CYCLE_STATE_CHANGED)                                          \
   EVENT(ACTIVITY_CYCLE_TO_ACTIVE)                                              \
-  EVENT(ACTIVITY_CYCLE_TO_INACTIVE)
+  EVENT(ACTIVITY_CYCLE_TO_INACTIVE)                                            \
+  EVENT(LAMP_DEFECT)                                                           \
+  EVENT(LAMP_RECOVERED)                                                        \
+  EVENT(CONFLICT)                                                              \
+  EVENT(CYCLE_READ_FAILED)
 
 enum class EventName {
 #define EVENT(name) name,
@@ -22,13 +28,60 @@ enum class EventName {
       COUNT
 };
 
+static_assert(static_cast<int>(EventName::COUNT) <= 32,
+              "Subscriptions of all events must fit into 32 bits");
+
+struct EventListener;
+class EventManager;
+class EventQueueBase;
+
 struct Event {
   EventName name;
   void (*callback)();
+  EventListener *listeners;
+};
+
+/**
+ * Data passed to event listeners
+ */
+struct EventPayload {
+  EventName name;
+  void *source;               // Object emitting the event, e.g. a TrafficLight
+  int slot;                   // Slot of the light in its bank, -1 if none
+  int lamp;                   // Lamp of a signal head, -1 if none
+  int phase_index;            // Phase of the cycle, -1 if none
+  unsigned long timestamp_ms; // Time of the event
+};
+
+/**
+ * A listener subscribed to an event
+ * Listeners are owned by the caller and linked by the EventManager, so any
+ * number of them can be subscribed without allocation. A listener is linked
+ * into one EventManager at a time.
+ */
+struct EventListener {
+  EventName name;
+  void (*callback)(void *context, const EventPayload &payload);
+  void *context;
+  EventListener *next;
+  EventManager *manager; // Manager the listener is subscribed to or nullptr
+
+  EventListener()
+      : name(EventName::COUNT), callback(nullptr), context(nullptr),
+        next(nullptr), manager(nullptr) {}
+
+  EventListener(EventName name,
+                void (*callback)(void *context, const EventPayload &payload),
+                void *context = nullptr)
+      : name(name), callback(callback), context(context), next(nullptr),
+        manager(nullptr) {}
 };
 
 class EventManager {
 public:
+  EventManager() = default;
+  ~EventManager();
+
   /**
    * Connects a callback function to an event
    * @param name The name of the event
@@ -43,17 +96,95 @@ public:
   void disconnect(EventName name);
 
   /**
-   * Triggers the callback function of an event
+   * Subscribes a listener to its event, in addition to other listeners
+   * Listeners are called in the order they subscribed. A listener
+   * subscribed to another manager is unsubscribed there first
+   * @param listener The listener, must stay valid while subscribed
+   */
+  void subscribe(EventListener &listener);
+
+  /**
+   * Subscribes a listener to every event, e.g. to record them, its name is
+   * ignored. Listeners of all events are called after those of the event
+   * @param listener The listener, must stay valid while subscribed
+   */
+  void subscribe_all(EventListener &listener);
+
+  /**
+   * Unsubscribes a listener from its event or from every event
+   * @param listener The listener
+   */
+  void unsubscribe(EventListener &listener);
+
+  /**
+   * Checks if a callback or listener is registered for an event
+   * @param name The name of the event
+   * @return True if the event has receivers, false otherwise
+   */
+  bool is_subscribed(EventName name) {
+    return (subscriptions & (1UL << static_cast<int>(name))) != 0;
+  }
+
+  /**
+   * Triggers the callback function and the listeners of an event
    * @param name The name of the event
    */
   void emit(EventName name);
 
+  /**
+   * Triggers the callback function and the listeners of an event
+   * If a queue is set the event is queued and delivered later by
+   * EventQueueBase::dispatch_events()
+   * @param payload The data of the event, including its name
+   */
+  void emit(const EventPayload &payload);
+
+  /**
+   * Calls the callback function and the listeners of an event immediately
+   * @param payload The data of the event, including its name
+   */
+  void dispatch(const EventPayload &payload);
+
+  /**
+   * Sets a queue deferring emitted events
+   * @param queue The queue, nullptr to deliver events immediately
+   */
+  void set_queue(EventQueueBase *queue);
+
 private:
   Event events[static_cast<int>(EventName::COUNT)] = {
-#define EVENT(name) {EventName::name, nullptr},
+#define EVENT(name) {EventName::name, nullptr, nullptr},
       EVENT_LIST
 #undef EVENT
   };
+  EventListener *all_listeners = nullptr; // Listeners of every event
+  uint32_t subscriptions = 0; // Bit set for events with receivers
+  EventQueueBase *queue = nullptr;
+
+  /**
+   * Updates the subscription bit of an event
+   * @param name The name of the event
+   */
+  void update_subscription(EventName name);
+
+  /**
+   * Appends a listener to a list
+   * @param link The head of the list
+   * @param listener The listener
+   */
+  void append(EventListener **link, EventListener &listener);
+
+  /**
+   * Removes a listener from a list
+   * @param link The head of the list
+   * @param listener The listener
+   * @return True if the listener was in the list, false otherwise
+   */
+  static bool remove(EventListener **link, EventListener &listener);
+
+  // Disable copy constructor and assignment
+  EventManager(const EventManager &) = delete;
+  EventManager &operator=(const EventManager &) = delete;
 };
 
 #endif
\ No newline at end of file
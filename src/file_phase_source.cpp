@@ -0,0 +1,85 @@
+#ifndef ARDUINO
+
+#include "file_phase_source.h"
+
+FilePhaseSource::FilePhaseSource() : file(nullptr), phase_count(0) {}
+
+FilePhaseSource::~FilePhaseSource() { close(); }
+
+bool FilePhaseSource::open(const char *path) {
+  close();
+
+  file = fopen(path, "rb");
+  if (file == nullptr)
+    return false;
+
+  if (fseek(file, 0, SEEK_END) != 0) {
+    close();
+    return false;
+  }
+  long size = ftell(file);
+  if (size < 0) {
+    close();
+    return false;
+  }
+  phase_count = size / sizeof(PackedPhase);
+  return true;
+}
+
+void FilePhaseSource::close() {
+  if (file != nullptr) {
+    fclose(file);
+    file = nullptr;
+  }
+  phase_count = 0;
+}
+
+bool FilePhaseSource::is_open() { return file != nullptr; }
+
+int FilePhaseSource::get_phase_count() { return phase_count; }
+
+int FilePhaseSource::read_phases(int index, Phase *phases, int count) {
+  if (file == nullptr || index < 0 || index >= phase_count)
+    return 0;
+  if (count > phase_count - index) {
+    count = phase_count - index;
+  }
+  if (fseek(file, static_cast<long>(index) * sizeof(PackedPhase), SEEK_SET) !=
+      0)
+    return 0;
+
+  PackedPhase chunk[CHUNK_SIZE];
+  int read_count = 0;
+  while (read_count < count) {
+    int wanted = count - read_count;
+    if (wanted > CHUNK_SIZE) {
+      wanted = CHUNK_SIZE;
+    }
+    int result = fread(chunk, sizeof(PackedPhase), wanted, file);
+    for (int i = 0; i < result; i++) {
+      unpack_phase(&chunk[i], false, phases[read_count + i]);
+    }
+    read_count += result;
+    if (result < wanted)
+      break;
+  }
+  return read_count;
+}
+
+bool FilePhaseSource::write_file(const char *path, const Phase *phases,
+                                 int count) {
+  FILE *out = fopen(path, "wb");
+  if (out == nullptr)
+    return false;
+
+  bool ok = true;
+  for (int i = 0; i < count && ok; i++) {
+    PackedPhase packed =
+        pack_phase(phases[i].pattern[0], phases[i].pattern[1],
+                   phases[i].pattern[2], phases[i].duration_ms);
+    ok = fwrite(&packed, sizeof(packed), 1, out) == 1;
+  }
+  return fclose(out) == 0 && ok;
+}
+
+#endif
\ No newline at end of file
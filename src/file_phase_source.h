@@ -0,0 +1,62 @@
+#ifndef FILE_PHASE_SOURCE_H
+#define FILE_PHASE_SOURCE_H
+
+#ifndef ARDUINO
+
+#include "phase_source.h"
+#include <stdio.h>
+
+/**
+ * Phase source reading a file on the host, e.g. to test streamed schedules.
+ * The file is a plain sequence of packed phases, 3 bytes each, as written
+ * by write_file() or by dumping a PackedPhase array.
+ */
+class FilePhaseSource : public PhaseSource {
+public:
+  FilePhaseSource();
+  ~FilePhaseSource() override;
+
+  /**
+   * Opens a phase file, closing the previous one.
+   * @param path The path of the file.
+   * @return True if the file was opened, false otherwise.
+   */
+  bool open(const char *path);
+
+  /**
+   * Closes the phase file.
+   */
+  void close();
+
+  /**
+   * Checks if a phase file is open.
+   * @return True if a file is open, false otherwise.
+   */
+  bool is_open();
+
+  int get_phase_count() override;
+  int read_phases(int index, Phase *phases, int count) override;
+
+  /**
+   * Writes phases to a phase file. Durations are packed, see pack_phase().
+   * @param path The path of the file, replaced if it exists.
+   * @param phases The phases.
+   * @param count The number of phases.
+   * @return True if the file was written, false otherwise.
+   */
+  static bool write_file(const char *path, const Phase *phases, int count);
+
+private:
+  static constexpr int CHUNK_SIZE = 32; // Phases unpacked per file read
+
+  FILE *file;
+  int phase_count;
+
+  // Disable copy constructor and assignment
+  FilePhaseSource(const FilePhaseSource &) = delete;
+  FilePhaseSource &operator=(const FilePhaseSource &) = delete;
+};
+
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,30 @@
+#include "hal.h"
+
+#ifdef ARDUINO
+#include "arduino_backend.h"
+typedef ArduinoBackend DefaultBackend;
+#else
+#include "host_backend.h"
+typedef HostBackend DefaultBackend;
+#endif
+
+void HardwareBackend::idle_until(unsigned long deadline_ms) {
+  while (!hal::time_reached(millis(), deadline_ms)) {
+  }
+}
+
+namespace {
+DefaultBackend default_backend;
+}
+
+namespace hal {
+
+TRAFFIC_LIGHT_THREAD_LOCAL HardwareBackend *backend = &default_backend;
+
+void set_backend(HardwareBackend *backend) {
+  hal::backend = (backend != nullptr) ? backend : &default_backend;
+}
+
+HardwareBackend *get_backend() { return backend; }
+
+} // namespace hal
@@ -0,0 +1,179 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+
+enum class PinMode : uint8_t { INPUT_MODE, OUTPUT_MODE, INPUT_PULLUP_MODE };
+
+/**
+ * A group of output pins resolved to a single port, so they can be written
+ * with one register access. Filled by HardwareBackend::bind_port().
+ */
+struct PortBinding {
+  static constexpr int MAX_PINS = 8;
+
+  uintptr_t port;          // Backend specific port handle
+  uint8_t bits[MAX_PINS];  // Backend specific bit of each pin in the port
+  uint8_t all_bits;        // All bits of the group combined
+  uint8_t count;           // Number of pins in the group
+};
+
+/**
+ * Interface to the clock, GPIO and ADC the library runs on.
+ * The library never talks to the hardware directly, so a different backend
+ * (e.g. a host simulation) can be plugged in with hal::set_backend().
+ */
+class HardwareBackend {
+public:
+  virtual ~HardwareBackend() = default;
+
+  /**
+   * Gets the time since startup.
+   * @return Time in milliseconds.
+   */
+  virtual unsigned long millis() = 0;
+
+  /**
+   * Configures a pin as input or output.
+   * @param pin The pin to configure.
+   * @param mode The mode of the pin.
+   */
+  virtual void pin_mode(int pin, PinMode mode) = 0;
+
+  /**
+   * Sets the state of a digital output pin.
+   * @param pin The pin to write.
+   * @param value True for HIGH, false for LOW.
+   */
+  virtual void digital_write(int pin, bool value) = 0;
+
+  /**
+   * Reads an analog input pin.
+   * @param pin The pin to read.
+   * @return The raw ADC reading.
+   */
+  virtual int analog_read(int pin) = 0;
+
+  /**
+   * Sets the duty cycle of a PWM output pin, e.g. to dim a lamp. Backends
+   * without PWM turn the pin on from half the duty cycle on.
+   * @param pin The pin to write.
+   * @param value The duty cycle, 0 (off) to 255 (on).
+   */
+  virtual void analog_write(int pin, uint8_t value) {
+    digital_write(pin, value >= 128);
+  }
+
+  /**
+   * Reads a digital input pin. Backends without digital inputs read LOW.
+   * @param pin The pin to read.
+   * @return True if the pin is HIGH, false otherwise.
+   */
+  virtual bool digital_read(int /*pin*/) { return false; }
+
+  /**
+   * Resolves a group of output pins to a single port.
+   * The default implementation does not support port access.
+   * @param pins The pins of the group.
+   * @param count The number of pins, at most PortBinding::MAX_PINS.
+   * @param binding The binding to fill.
+   * @return True if all pins share one port, false otherwise.
+   */
+  virtual bool bind_port(const int * /*pins*/, int /*count*/,
+                         PortBinding & /*binding*/) {
+    return false;
+  }
+
+  /**
+   * Writes all pins of a port binding at once.
+   * @param binding A binding filled by bind_port().
+   * @param mask Bit i set turns pin i of the group on.
+   */
+  virtual void write_port(const PortBinding & /*binding*/, uint8_t /*mask*/) {}
+
+  /**
+   * Idles until a point in time is reached.
+   * The default implementation busy-waits on millis().
+   * @param deadline_ms The point in time in milliseconds.
+   */
+  virtual void idle_until(unsigned long deadline_ms);
+};
+
+// Host builds keep the backend per thread, so threads can run lights on
+// their own virtual clocks
+#ifdef ARDUINO
+#define TRAFFIC_LIGHT_THREAD_LOCAL
+#else
+#define TRAFFIC_LIGHT_THREAD_LOCAL thread_local
+#endif
+
+namespace hal {
+
+extern TRAFFIC_LIGHT_THREAD_LOCAL HardwareBackend *backend;
+
+/**
+ * Sets the backend used by the library.
+ * On host builds the backend is set for the calling thread only.
+ * @param backend The backend, nullptr to restore the default backend.
+ */
+void set_backend(HardwareBackend *backend);
+
+/**
+ * Gets the backend used by the library.
+ * @return The active backend.
+ */
+HardwareBackend *get_backend();
+
+inline unsigned long millis() { return backend->millis(); }
+
+/**
+ * Checks if a point in time has been reached, robust against the overflow of
+ * millis() as long as both times are less than ~24 days apart.
+ * @param now The current time in milliseconds.
+ * @param deadline The point in time in milliseconds.
+ * @return True if now is at or after the deadline, false otherwise.
+ */
+inline bool time_reached(unsigned long now, unsigned long deadline) {
+  return static_cast<long>(now - deadline) >= 0;
+}
+
+inline void pin_mode(int pin, PinMode mode) { backend->pin_mode(pin, mode); }
+
+inline void digital_write(int pin, bool value) {
+  backend->digital_write(pin, value);
+}
+
+inline void analog_write(int pin, uint8_t value) {
+  backend->analog_write(pin, value);
+}
+
+inline int analog_read(int pin) { return backend->analog_read(pin); }
+
+inline bool digital_read(int pin) { return backend->digital_read(pin); }
+
+inline bool bind_port(const int *pins, int count, PortBinding &binding) {
+  return backend->bind_port(pins, count, binding);
+}
+
+inline void write_port(const PortBinding &binding, uint8_t mask) {
+  backend->write_port(binding, mask);
+}
+
+inline void idle_until(unsigned long deadline_ms) {
+  backend->idle_until(deadline_ms);
+}
+
+/**
+ * Gets the earlier of two points in time, robust against the overflow of
+ * millis().
+ * @param a The first point in time in milliseconds.
+ * @param b The second point in time in milliseconds.
+ * @return The earlier point in time.
+ */
+inline unsigned long earliest(unsigned long a, unsigned long b) {
+  return time_reached(b, a) ? a : b;
+}
+
+} // namespace hal
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef ARDUINO
+
+#include "host_backend.h"
+
+unsigned long HostBackend::millis() { return time_ms; }
+
+void HostBackend::pin_mode(int pin, PinMode mode) {
+  if (pin < 0 || pin >= MAX_PINS)
+    return;
+  pin_modes[pin] = mode;
+}
+
+void HostBackend::digital_write(int pin, bool value) {
+  digital_write_count++;
+  if (pin < 0 || pin >= MAX_PINS)
+    return;
+  digital_values[pin] = value;
+  pwm_values[pin] = 0; // Like on Arduino boards, the pin leaves PWM
+}
+
+void HostBackend::analog_write(int pin, uint8_t value) {
+  if (pin < 0 || pin >= MAX_PINS)
+    return;
+  pwm_values[pin] = value;
+  digital_values[pin] = value > 0;
+}
+
+int HostBackend::analog_read(int pin) {
+  analog_read_count++;
+  if (pin < 0 || pin >= MAX_PINS)
+    return 0;
+  return analog_values[pin];
+}
+
+bool HostBackend::digital_read(int pin) {
+  if (pin < 0 || pin >= MAX_PINS)
+    return false;
+  return digital_values[pin];
+}
+
+bool HostBackend::bind_port(const int *pins, int count,
+                            PortBinding &binding) {
+  if (count <= 0 || count > PortBinding::MAX_PINS)
+    return false;
+
+  binding.all_bits = 0;
+  for (int i = 0; i < count; i++) {
+    if (pins[i] < 0 || pins[i] >= MAX_PINS)
+      return false;
+    binding.bits[i] = pins[i]; // The simulated port addresses pins directly
+    binding.all_bits |= (1 << i);
+  }
+  binding.port = 0;
+  binding.count = count;
+  return true;
+}
+
+void HostBackend::write_port(const PortBinding &binding, uint8_t mask) {
+  port_write_count++;
+  for (uint8_t i = 0; i < binding.count; i++) {
+    digital_values[binding.bits[i]] = (mask & (1 << i)) != 0;
+  }
+}
+
+void HostBackend::idle_until(unsigned long deadline_ms) {
+  if (!hal::time_reached(time_ms, deadline_ms)) {
+    time_ms = deadline_ms;
+  }
+}
+
+void HostBackend::set_time_ms(unsigned long time_ms) {
+  this->time_ms = time_ms;
+}
+
+void HostBackend::advance_ms(unsigned long delta_ms) { time_ms += delta_ms; }
+
+void HostBackend::set_analog_value(int pin, int value) {
+  if (pin < 0 || pin >= MAX_PINS)
+    return;
+  analog_values[pin] = value;
+}
+
+void HostBackend::set_digital_value(int pin, bool value) {
+  if (pin < 0 || pin >= MAX_PINS)
+    return;
+  digital_values[pin] = value;
+}
+
+bool HostBackend::get_digital_value(int pin) {
+  if (pin < 0 || pin >= MAX_PINS)
+    return false;
+  return digital_values[pin];
+}
+
+uint8_t HostBackend::get_pwm_value(int pin) {
+  if (pin < 0 || pin >= MAX_PINS)
+    return 0;
+  return pwm_values[pin];
+}
+
+PinMode HostBackend::get_pin_mode(int pin) {
+  if (pin < 0 || pin >= MAX_PINS)
+    return PinMode::INPUT_MODE;
+  return pin_modes[pin];
+}
+
+unsigned long HostBackend::get_digital_write_count() {
+  return digital_write_count;
+}
+
+unsigned long HostBackend::get_analog_read_count() { return analog_read_count; }
+
+unsigned long HostBackend::get_port_write_count() { return port_write_count; }
+
+void HostBackend::reset_counters() {
+  digital_write_count = 0;
+  analog_read_count = 0;
+  port_write_count = 0;
+}
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef HOST_BACKEND_H
+#define HOST_BACKEND_H
+
+#ifndef ARDUINO
+
+#include "hal.h"
+
+/**
+ * Backend for running the library on a host (e.g. Linux).
+ * The clock is virtual and only advances when told to, which makes runs
+ * reproducible. Pins are simulated in memory, every group of pins can be
+ * bound to a simulated port.
+ * This is the default backend on non Arduino builds.
+ */
+class HostBackend : public HardwareBackend {
+public:
+  static constexpr int MAX_PINS = 64;
+
+  constexpr HostBackend()
+      : time_ms(0), pin_modes(), digital_values(), analog_values(),
+        pwm_values(), digital_write_count(0), analog_read_count(0),
+        port_write_count(0) {}
+
+  unsigned long millis() override;
+  void pin_mode(int pin, PinMode mode) override;
+  void digital_write(int pin, bool value) override;
+  void analog_write(int pin, uint8_t value) override;
+  int analog_read(int pin) override;
+  bool digital_read(int pin) override;
+  bool bind_port(const int *pins, int count, PortBinding &binding) override;
+  void write_port(const PortBinding &binding, uint8_t mask) override;
+
+  /**
+   * Advances the virtual time to the deadline instead of waiting.
+   * @param deadline_ms The point in time in milliseconds.
+   */
+  void idle_until(unsigned long deadline_ms) override;
+
+  /**
+   * Sets the virtual time.
+   * @param time_ms The new time in milliseconds.
+   */
+  void set_time_ms(unsigned long time_ms);
+
+  /**
+   * Advances the virtual time.
+   * @param delta_ms The time in milliseconds to advance.
+   */
+  void advance_ms(unsigned long delta_ms);
+
+  /**
+   * Sets the value returned by analog_read() for a pin.
+   * @param pin The pin.
+   * @param value The raw ADC reading.
+   */
+  void set_analog_value(int pin, int value);
+
+  /**
+   * Sets the value returned by digital_read() for a pin.
+   * @param pin The pin.
+   * @param value True for HIGH, false for LOW.
+   */
+  void set_digital_value(int pin, bool value);
+
+  /**
+   * Gets the last value written to a digital pin.
+   * @param pin The pin.
+   * @return True if the pin is HIGH, false otherwise.
+   */
+  bool get_digital_value(int pin);
+
+  /**
+   * Gets the last duty cycle written to a PWM pin with analog_write().
+   * @param pin The pin.
+   * @return The duty cycle, 0 if the pin was written with digital_write().
+   */
+  uint8_t get_pwm_value(int pin);
+
+  /**
+   * Gets the mode of a pin.
+   * @param pin The pin.
+   * @return The mode of the pin.
+   */
+  PinMode get_pin_mode(int pin);
+
+  /**
+   * Gets the number of digital_write() calls since the last reset.
+   * @return The number of calls.
+   */
+  unsigned long get_digital_write_count();
+
+  /**
+   * Gets the number of analog_read() calls since the last reset.
+   * @return The number of calls.
+   */
+  unsigned long get_analog_read_count();
+
+  /**
+   * Gets the number of write_port() calls since the last reset.
+   * @return The number of calls.
+   */
+  unsigned long get_port_write_count();
+
+  /**
+   * Resets the call counters.
+   */
+  void reset_counters();
+
+private:
+  unsigned long time_ms;
+  PinMode pin_modes[MAX_PINS];
+  bool digital_values[MAX_PINS];
+  int analog_values[MAX_PINS];
+  uint8_t pwm_values[MAX_PINS];
+  unsigned long digital_write_count;
+  unsigned long analog_read_count;
+  unsigned long port_write_count;
+};
+
+#endif
+
+#endif
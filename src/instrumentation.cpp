@@ -0,0 +1,167 @@
+#include "instrumentation.h"
+
+#ifdef TRAFFIC_LIGHT_INSTRUMENTATION
+
+#include "hal.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+namespace instrumentation {
+
+namespace {
+
+constexpr uint8_t BINARY_VERSION = 4;
+constexpr int HISTOGRAM_WORDS = 2 + Histogram::BUCKETS;
+constexpr int STAGE_COUNT = static_cast<int>(Stage::COUNT);
+constexpr int EVENT_COUNT = static_cast<int>(EventName::COUNT);
+
+const char *const stage_names[] = {"traffic_light_update", "cycle_update",
+                                   "defect_test"};
+
+const char *const event_names[] = {
+#define EVENT(name) #name,
+    EVENT_LIST
+#undef EVENT
+};
+
+static_assert(sizeof(stage_names) / sizeof(stage_names[0]) == STAGE_COUNT,
+              "Every stage needs a name");
+
+TRAFFIC_LIGHT_THREAD_LOCAL Snapshot snapshot;
+
+uint8_t *write_word(uint8_t *out, uint32_t word) {
+  out[0] = word & 0xFF;
+  out[1] = (word >> 8) & 0xFF;
+  out[2] = (word >> 16) & 0xFF;
+  out[3] = (word >> 24) & 0xFF;
+  return out + 4;
+}
+
+uint8_t *write_histogram(uint8_t *out, const Histogram &histogram) {
+  out = write_word(out, histogram.count);
+  out = write_word(out, histogram.max);
+  for (int i = 0; i < Histogram::BUCKETS; i++) {
+    out = write_word(out, histogram.buckets[i]);
+  }
+  return out;
+}
+
+void write_number(void (*write)(void *context, const char *text),
+                  void *context, uint32_t number) {
+  char text[11];
+  char *digit = text + sizeof(text) - 1;
+  *digit = '\0';
+  do {
+    *--digit = '0' + number % 10;
+    number /= 10;
+  } while (number != 0);
+  write(context, digit);
+}
+
+void write_histogram_text(void (*write)(void *context, const char *text),
+                          void *context, const char *name,
+                          const Histogram &histogram) {
+  write(context, name);
+  write(context, " count=");
+  write_number(write, context, histogram.count);
+  write(context, " max=");
+  write_number(write, context, histogram.max);
+  write(context, " buckets=");
+  for (int i = 0; i < Histogram::BUCKETS; i++) {
+    if (i > 0)
+      write(context, ",");
+    write_number(write, context, histogram.buckets[i]);
+  }
+  write(context, "\n");
+}
+
+} // namespace
+
+void Histogram::record(uint32_t value) {
+  // Bucket is the number of significant bits
+  int bucket = 0;
+  for (uint32_t rest = value; rest != 0 && bucket < BUCKETS - 1;
+       rest >>= 1) {
+    bucket++;
+  }
+
+  count++;
+  buckets[bucket]++;
+  if (value > max) {
+    max = value;
+  }
+}
+
+unsigned long read_ticks() {
+#ifdef ARDUINO
+  return micros();
+#else
+  return static_cast<unsigned long>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+#endif
+}
+
+void record_stage(Stage stage, unsigned long ticks) {
+  snapshot.stages[static_cast<int>(stage)].record(ticks);
+}
+
+void count_event(EventName name) {
+  snapshot.events[static_cast<int>(name)]++;
+}
+
+void record_lateness(unsigned long late_ms) {
+  snapshot.lateness_ms.record(late_ms);
+}
+
+const Snapshot &get_snapshot() { return snapshot; }
+
+void reset() { snapshot = Snapshot(); }
+
+size_t get_binary_size() {
+  return 4 + 4 * ((STAGE_COUNT + 1) * HISTOGRAM_WORDS + EVENT_COUNT);
+}
+
+size_t write_binary(uint8_t *buffer, size_t size) {
+  if (size < get_binary_size())
+    return 0;
+
+  uint8_t *out = buffer;
+  *out++ = 'T';
+  *out++ = 'L';
+  *out++ = 'I';
+  *out++ = BINARY_VERSION;
+
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    out = write_histogram(out, snapshot.stages[i]);
+  }
+  out = write_histogram(out, snapshot.lateness_ms);
+  for (int i = 0; i < EVENT_COUNT; i++) {
+    out = write_word(out, snapshot.events[i]);
+  }
+
+  return out - buffer;
+}
+
+void write_text(void (*write)(void *context, const char *text),
+                void *context) {
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    write_histogram_text(write, context, stage_names[i], snapshot.stages[i]);
+  }
+  write_histogram_text(write, context, "lateness_ms", snapshot.lateness_ms);
+  for (int i = 0; i < EVENT_COUNT; i++) {
+    write(context, event_names[i]);
+    write(context, "=");
+    write_number(write, context, snapshot.events[i]);
+    write(context, "\n");
+  }
+}
+
+} // namespace instrumentation
+
+#endif
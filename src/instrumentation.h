@@ -0,0 +1,153 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include "events.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Optional measurements of the library's hot paths.
+ * Define TRAFFIC_LIGHT_INSTRUMENTATION for the build to record how long the
+ * update stages take, how often each event is emitted and how late phases
+ * change. Without it, the hooks are empty inline functions and no code or
+ * memory is used.
+ *
+ * Durations are measured in ticks: microseconds on Arduino boards,
+ * nanoseconds on hosts. On hosts the data is kept per thread.
+ */
+namespace instrumentation {
+
+/**
+ * Measured sections of code
+ */
+enum class Stage : uint8_t {
+  TRAFFIC_LIGHT_UPDATE, // TrafficLight::update()
+  CYCLE_UPDATE,         // Cycle::update()
+  DEFECT_TEST,          // Testing a light for defects
+  COUNT
+};
+
+#ifdef TRAFFIC_LIGHT_INSTRUMENTATION
+
+/**
+ * Histogram with power of two buckets
+ * Bucket 0 counts the value 0, bucket i values from 2^(i-1) to 2^i - 1, the
+ * last bucket all larger values.
+ */
+struct Histogram {
+  static constexpr int BUCKETS = 16;
+
+  uint32_t count;
+  uint32_t max;
+  uint32_t buckets[BUCKETS];
+
+  /**
+   * Adds a value to the histogram
+   * @param value The value
+   */
+  void record(uint32_t value);
+};
+
+/**
+ * All recorded measurements
+ */
+struct Snapshot {
+  Histogram stages[static_cast<int>(Stage::COUNT)]; // Durations in ticks
+  Histogram lateness_ms; // Phase changes by ms after their deadline
+  uint32_t events[static_cast<int>(EventName::COUNT)]; // Emitted events
+};
+
+/**
+ * Reads the clock used to measure durations
+ * @return The current time in ticks
+ */
+unsigned long read_ticks();
+
+/**
+ * Records the duration of a stage
+ * @param stage The stage
+ * @param ticks The duration in ticks
+ */
+void record_stage(Stage stage, unsigned long ticks);
+
+/**
+ * Counts an emitted event, whether anyone listens to it or not
+ * @param name The name of the event
+ */
+void count_event(EventName name);
+
+/**
+ * Records a phase change
+ * @param late_ms Time between the deadline and the phase change
+ */
+void record_lateness(unsigned long late_ms);
+
+/**
+ * Gets the recorded measurements
+ * Late phase changes are lateness_ms.count - lateness_ms.buckets[0].
+ * @return The measurements
+ */
+const Snapshot &get_snapshot();
+
+/**
+ * Clears all measurements
+ */
+void reset();
+
+/**
+ * Gets the size of the binary snapshot
+ * @return The size in bytes
+ */
+size_t get_binary_size();
+
+/**
+ * Writes the measurements as little endian 32 bit words after a 4 byte
+ * header ("TLI" and the format version): the stage histograms, the lateness
+ * histogram, then the event counts. Each histogram is count, max, buckets.
+ * @param buffer The buffer to write to
+ * @param size The size of the buffer
+ * @return The number of bytes written, 0 if the buffer is too small
+ */
+size_t write_binary(uint8_t *buffer, size_t size);
+
+/**
+ * Writes the measurements as text, one line per histogram or event
+ * @param write Called with each piece of text
+ * @param context Passed to write
+ */
+void write_text(void (*write)(void *context, const char *text),
+                void *context);
+
+/**
+ * Measures the duration of a scope
+ */
+class ScopeTimer {
+public:
+  explicit ScopeTimer(Stage stage) : stage(stage), start(read_ticks()) {}
+  ~ScopeTimer() { record_stage(stage, read_ticks() - start); }
+
+private:
+  Stage stage;
+  unsigned long start;
+
+  // Disable copy constructor and assignment
+  ScopeTimer(const ScopeTimer &) = delete;
+  ScopeTimer &operator=(const ScopeTimer &) = delete;
+};
+
+#else
+
+inline void count_event(EventName /*name*/) {}
+
+inline void record_lateness(unsigned long /*late_ms*/) {}
+
+class ScopeTimer {
+public:
+  explicit ScopeTimer(Stage /*stage*/) {}
+};
+
+#endif
+
+} // namespace instrumentation
+
+#endif
@@ -0,0 +1,72 @@
+#include "interrupt_timer.h"
+#include "hal.h"
+
+InterruptTimer::InterruptTimer()
+    : wheel(nullptr), deadline_ms(0), max_lateness_ms(0), armed(false) {}
+
+bool InterruptTimer::begin(TimerWheel &wheel) {
+  end();
+  if (!start())
+    return false;
+
+  lock();
+  this->wheel = &wheel;
+  unlock(); // Arms the timer for the first deadline
+  return true;
+}
+
+void InterruptTimer::end() {
+  if (wheel == nullptr)
+    return;
+
+  lock();
+  wheel = nullptr;
+  unlock(); // Disarms the timer
+  stop();
+}
+
+bool InterruptTimer::is_running() { return wheel != nullptr; }
+
+void InterruptTimer::handle_expiry() {
+  if (wheel == nullptr)
+    return;
+
+  unsigned long now = hal::millis();
+  if (armed && hal::time_reached(now, deadline_ms)) {
+    unsigned long lateness_ms = now - deadline_ms;
+    if (lateness_ms > max_lateness_ms) {
+      max_lateness_ms = lateness_ms;
+    }
+  }
+
+  wheel->advance(now);
+  rearm();
+}
+
+void InterruptTimer::rearm() {
+  unsigned long next_ms;
+  if (wheel != nullptr && wheel->get_next_deadline(next_ms)) {
+    deadline_ms = next_ms;
+    armed = true;
+    arm(next_ms);
+  } else {
+    armed = false;
+    disarm();
+  }
+}
+
+unsigned long InterruptTimer::get_max_lateness_ms() {
+  // The timer context may update the value while it is read, read it until
+  // two reads agree
+  unsigned long lateness_ms;
+  do {
+    lateness_ms = max_lateness_ms;
+  } while (lateness_ms != max_lateness_ms);
+  return lateness_ms;
+}
+
+void InterruptTimer::reset_max_lateness() {
+  lock();
+  max_lateness_ms = 0;
+  unlock();
+}
@@ -0,0 +1,116 @@
+#ifndef INTERRUPT_TIMER_H
+#define INTERRUPT_TIMER_H
+
+#include "timer_wheel.h"
+
+/**
+ * Drives a TimerWheel from a hardware timer instead of loop().
+ * The timer is armed for the next deadline of the wheel and updates the
+ * traffic lights attached to it from the timer context, so the lamps change
+ * on time no matter what the rest of the program is doing.
+ * While running, the wheel and its traffic lights belong to the timer
+ * context: change them only between lock() and unlock(), and deliver their
+ * events with an EventQueue, as listeners would otherwise run in the timer
+ * context as well. The same holds for the PhaseStream of a streamed cycle:
+ * refill it only while locked. A phase missing in the stream is read from
+ * its source in the timer context.
+ * Subclasses implement the timer of a platform, see AvrTimer1 and
+ * TimerfdTimer.
+ */
+class InterruptTimer {
+private:
+  TimerWheel *wheel;
+  volatile unsigned long deadline_ms;
+  volatile unsigned long max_lateness_ms;
+  volatile bool armed;
+
+  // Disable copy constructor and assignment
+  InterruptTimer(const InterruptTimer &) = delete;
+  InterruptTimer &operator=(const InterruptTimer &) = delete;
+
+protected:
+  InterruptTimer();
+
+  /**
+   * Starts the timer hardware without arming it.
+   * @return True if the timer could be started, false otherwise.
+   */
+  virtual bool start() = 0;
+
+  /**
+   * Stops the timer hardware.
+   */
+  virtual void stop() = 0;
+
+  /**
+   * Arms the timer to expire at a point in time. Called from the timer
+   * context or while locked. A deadline in the past expires as soon as
+   * possible, one further away than the timer can count may expire early.
+   * @param deadline_ms The point in time in milliseconds.
+   */
+  virtual void arm(unsigned long deadline_ms) = 0;
+
+  /**
+   * Disarms the timer. Called from the timer context or while locked.
+   */
+  virtual void disarm() = 0;
+
+  /**
+   * Updates the wheel and arms the timer for its next deadline.
+   * To be called by subclasses in the timer context when the timer expires.
+   */
+  void handle_expiry();
+
+  /**
+   * Arms or disarms the timer for the next deadline of the wheel.
+   */
+  void rearm();
+
+public:
+  virtual ~InterruptTimer() = default;
+
+  /**
+   * Starts driving a wheel. Attach the traffic lights to the wheel first and
+   * stop calling update() for them.
+   * @param wheel The wheel, must stay valid while driven.
+   * @return True if the timer was started, false otherwise.
+   */
+  bool begin(TimerWheel &wheel);
+
+  /**
+   * Stops driving the wheel.
+   */
+  void end();
+
+  /**
+   * Checks if the timer drives a wheel.
+   * @return True if the timer is running, false otherwise.
+   */
+  bool is_running();
+
+  /**
+   * Keeps the timer context from running, so the wheel and its traffic
+   * lights can be changed. Locks do not nest.
+   */
+  virtual void lock() = 0;
+
+  /**
+   * Lets the timer context run again and arms the timer for the next
+   * deadline, which the changes made while locked may have moved.
+   */
+  virtual void unlock() = 0;
+
+  /**
+   * Gets how late the timer expired at most after its deadline, i.e. the
+   * switching jitter of the driven traffic lights.
+   * @return The maximum lateness in milliseconds.
+   */
+  unsigned long get_max_lateness_ms();
+
+  /**
+   * Resets the maximum lateness.
+   */
+  void reset_max_lateness();
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "output_stage.h"
+
+OutputStage::OutputStage()
+    : pins(nullptr), count(0), written_mask(0), written_pwm_mask(0),
+      written_level(0), flags(0), binding() {}
+
+void OutputStage::begin(const int *pins, int count) {
+  if (count > PortBinding::MAX_PINS) {
+    count = PortBinding::MAX_PINS;
+  }
+  this->pins = pins;
+  this->count = count;
+  flags = 0; // Clear all flags, port mode has to be enabled again
+
+  for (int i = 0; i < count; i++) {
+    hal::pin_mode(pins[i], PinMode::OUTPUT_MODE);
+    hal::digital_write(pins[i], false);
+  }
+  written_mask = 0;
+  written_pwm_mask = 0;
+  flags |= (1 << FLAG_WRITTEN);
+}
+
+bool OutputStage::is_port_mode_enabled() {
+  return (flags & (1 << FLAG_PORT_MODE)) != 0;
+}
+
+bool OutputStage::enable_port_mode() {
+  if (count == 0 || !hal::bind_port(pins, count, binding)) {
+    flags &= ~(1 << FLAG_PORT_MODE);
+    return false;
+  }
+  flags |= (1 << FLAG_PORT_MODE);
+  return true;
+}
+
+void OutputStage::disable_port_mode() { flags &= ~(1 << FLAG_PORT_MODE); }
+
+bool OutputStage::needs_commit(uint8_t mask, uint8_t pwm_mask,
+                               uint8_t level) {
+  if (flags & (1 << FLAG_PORT_MODE)) {
+    mask = (mask & ~pwm_mask) | (level >= 128 ? pwm_mask : 0);
+    pwm_mask = 0;
+  }
+  return !(flags & (1 << FLAG_WRITTEN)) ||
+         (mask & ~pwm_mask) != (written_mask & ~written_pwm_mask) ||
+         pwm_mask != written_pwm_mask ||
+         (pwm_mask != 0 && level != written_level);
+}
+
+void OutputStage::commit(uint8_t mask, uint8_t pwm_mask, uint8_t level) {
+  // Nothing to do if the outputs already show the mask
+  if (!needs_commit(mask, pwm_mask, level)) {
+    return;
+  }
+
+  if (flags & (1 << FLAG_PORT_MODE)) {
+    // The port write would stop PWM, dimmed outputs are turned on or off
+    mask = (mask & ~pwm_mask) | (level >= 128 ? pwm_mask : 0);
+    pwm_mask = 0;
+    hal::write_port(binding, mask);
+  } else {
+    uint8_t changed = 0xFF;
+    uint8_t dimmed = pwm_mask;
+    if (flags & (1 << FLAG_WRITTEN)) {
+      changed = (mask ^ written_mask) | (pwm_mask ^ written_pwm_mask);
+      if (level == written_level) {
+        dimmed &= changed;
+      }
+    }
+    for (uint8_t i = 0; i < count; i++) {
+      if (dimmed & (1 << i)) {
+        hal::analog_write(pins[i], level);
+      } else if ((changed & ~pwm_mask) & (1 << i)) {
+        hal::digital_write(pins[i], (mask & (1 << i)) != 0);
+      }
+    }
+  }
+
+  written_mask = mask;
+  written_pwm_mask = pwm_mask;
+  written_level = level;
+  flags |= (1 << FLAG_WRITTEN);
+}
+
+void OutputStage::invalidate() { flags &= ~(1 << FLAG_WRITTEN); }
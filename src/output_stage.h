@@ -0,0 +1,80 @@
+#ifndef OUTPUT_STAGE_H
+#define OUTPUT_STAGE_H
+
+#include "hal.h"
+#include <stdint.h>
+
+class OutputStage {
+private:
+  // Bit positions for flags
+  static constexpr uint8_t FLAG_WRITTEN = 0;
+  static constexpr uint8_t FLAG_PORT_MODE = 1;
+
+  const int *pins;
+  uint8_t count;
+  uint8_t written_mask;
+  uint8_t written_pwm_mask;
+  uint8_t written_level;
+  uint8_t flags; // Bitfield for boolean flags
+  PortBinding binding;
+
+  // Disable copy constructor and assignment
+  OutputStage(const OutputStage &) = delete;
+  OutputStage &operator=(const OutputStage &) = delete;
+
+public:
+  OutputStage();
+  ~OutputStage() = default;
+
+  /**
+   * Configures the output pins and turns them off.
+   * @param pins Array of pins, must stay valid while the stage is used.
+   * @param count Number of pins, at most PortBinding::MAX_PINS.
+   */
+  void begin(const int *pins, int count);
+
+  /**
+   * Checks if the outputs are written with a single port access.
+   * @return True if port mode is enabled, false otherwise.
+   */
+  bool is_port_mode_enabled();
+
+  /**
+   * Enables writing all outputs with a single port access.
+   * The pins are resolved to their port once.
+   * @return True if all pins share a port, false if the stage keeps writing
+   * the pins one by one.
+   */
+  bool enable_port_mode();
+
+  /**
+   * Disables port mode, the pins are written one by one.
+   */
+  void disable_port_mode();
+
+  /**
+   * Checks if committing a mask would write the outputs.
+   * @param mask Bit i set turns output i on.
+   * @param pwm_mask Bit i set dims output i, see commit().
+   * @param level The duty cycle of the dimmed outputs.
+   * @return True if the outputs differ from the mask, false otherwise.
+   */
+  bool needs_commit(uint8_t mask, uint8_t pwm_mask = 0, uint8_t level = 0);
+
+  /**
+   * Writes the outputs if the mask differs from the last written one.
+   * In port mode dimmed outputs are turned on from half the duty cycle on.
+   * @param mask Bit i set turns output i on.
+   * @param pwm_mask Bit i set dims output i with PWM instead, its bit in mask
+   * is ignored.
+   * @param level The duty cycle of the dimmed outputs, 0 to 255.
+   */
+  void commit(uint8_t mask, uint8_t pwm_mask = 0, uint8_t level = 0);
+
+  /**
+   * Forces the next commit to write all outputs.
+   */
+  void invalidate();
+};
+
+#endif
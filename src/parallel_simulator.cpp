@@ -0,0 +1,225 @@
+#ifndef ARDUINO
+
+#include "parallel_simulator.h"
+
+#include <functional>
+#include <queue>
+
+ParallelSimulator::Partition::Partition(unsigned long start_ms,
+                                        int first_light)
+    : clock(), simulator(clock), events(), first_light(first_light) {
+  clock.set_time_ms(start_ms);
+}
+
+ParallelSimulator::ParallelSimulator(int thread_count)
+    : partitions(), ranges(nullptr), workers(), mutex(), window_started(),
+      window_finished(), window_count(0), horizon_ms(0), busy_count(0),
+      stopping(false), thread_count(thread_count),
+      light_count(0), time_ms(hal::millis()), window_ms(0), event_count(0),
+      sink(nullptr), sink_context(nullptr) {
+  if (this->thread_count <= 0) {
+    this->thread_count = static_cast<int>(std::thread::hardware_concurrency());
+    if (this->thread_count <= 0) {
+      this->thread_count = 1; // Number of cores unknown
+    }
+  }
+  ranges = new WorkRange[this->thread_count];
+}
+
+ParallelSimulator::~ParallelSimulator() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  window_started.notify_all();
+  for (size_t i = 0; i < workers.size(); i++) {
+    workers[i].join();
+  }
+
+  for (size_t i = 0; i < partitions.size(); i++) {
+    delete partitions[i];
+  }
+  delete[] ranges;
+}
+
+int ParallelSimulator::add(TrafficLight &light) {
+  if (light_count % PARTITION_SIZE == 0) {
+    partitions.push_back(new Partition(time_ms, light_count));
+    partitions.back()->simulator.set_event_sink(on_event, partitions.back());
+  }
+
+  // Schedule the light on the clock of its partition
+  Partition &partition = *partitions.back();
+  HardwareBackend *previous_backend = hal::get_backend();
+  hal::set_backend(&partition.clock);
+  partition.simulator.add(light);
+  hal::set_backend(previous_backend);
+
+  return light_count++;
+}
+
+int ParallelSimulator::get_count() { return light_count; }
+
+int ParallelSimulator::get_thread_count() { return thread_count; }
+
+unsigned long ParallelSimulator::get_time_ms() { return time_ms; }
+
+unsigned long ParallelSimulator::get_event_count() { return event_count; }
+
+void ParallelSimulator::set_event_sink(
+    void (*sink)(void *context, const SimulationEvent &event), void *context) {
+  this->sink = sink;
+  sink_context = context;
+}
+
+void ParallelSimulator::set_merge_window(unsigned long window_ms) {
+  this->window_ms = window_ms;
+}
+
+void ParallelSimulator::run_until(unsigned long end_ms) {
+  while (!hal::time_reached(time_ms, end_ms)) {
+    unsigned long horizon_ms = end_ms;
+    if (window_ms > 0 && !hal::time_reached(time_ms + window_ms, end_ms)) {
+      horizon_ms = time_ms + window_ms;
+    }
+
+    run_partitions(horizon_ms);
+    merge_events();
+    time_ms = horizon_ms;
+  }
+}
+
+void ParallelSimulator::run_for(unsigned long duration_ms) {
+  run_until(time_ms + duration_ms);
+}
+
+void ParallelSimulator::run_partitions(unsigned long horizon_ms) {
+  int partition_count = static_cast<int>(partitions.size());
+
+  // Give every thread an equal share to start with
+  for (int i = 0; i < thread_count; i++) {
+    ranges[i].next.store(partition_count * i / thread_count);
+    ranges[i].end = partition_count * (i + 1) / thread_count;
+  }
+
+  // The calling thread is the first worker, the others are started once
+  if (workers.empty()) {
+    for (int i = 1; i < thread_count; i++) {
+      workers.emplace_back(&ParallelSimulator::run_worker, this, i);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->horizon_ms = horizon_ms;
+    busy_count = thread_count - 1;
+    window_count++;
+  }
+  window_started.notify_all();
+
+  work(0, horizon_ms);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  window_finished.wait(lock, [this] { return busy_count == 0; });
+}
+
+void ParallelSimulator::run_worker(int worker) {
+  unsigned long done_count = 0;
+
+  for (;;) {
+    unsigned long window_horizon_ms;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      window_started.wait(
+          lock, [&] { return stopping || window_count != done_count; });
+      if (stopping)
+        return;
+      done_count = window_count;
+      window_horizon_ms = horizon_ms;
+    }
+
+    work(worker, window_horizon_ms);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--busy_count == 0) {
+      window_finished.notify_one();
+    }
+  }
+}
+
+void ParallelSimulator::work(int worker, unsigned long horizon_ms) {
+  HardwareBackend *previous_backend = hal::get_backend();
+
+  // Work through the own range, then steal from the ranges of the others
+  for (int i = 0; i < thread_count; i++) {
+    WorkRange &range = ranges[(worker + i) % thread_count];
+    for (;;) {
+      int index = range.next.fetch_add(1, std::memory_order_relaxed);
+      if (index >= range.end) {
+        break;
+      }
+
+      Partition &partition = *partitions[index];
+      hal::set_backend(&partition.clock);
+      partition.simulator.run_until(horizon_ms);
+    }
+  }
+
+  hal::set_backend(previous_backend);
+}
+
+void ParallelSimulator::merge_events() {
+  for (size_t i = 0; i < partitions.size(); i++) {
+    event_count += partitions[i]->events.size();
+  }
+
+  if (sink != nullptr) {
+    // Earliest event first, ties go to the partition with the lower lights,
+    // which is the order of a single Simulator
+    struct Head {
+      unsigned long offset_ms; // Time since the start of the window
+      size_t partition;
+      size_t index;
+      bool operator>(const Head &other) const {
+        return offset_ms != other.offset_ms ? offset_ms > other.offset_ms
+                                            : partition > other.partition;
+      }
+    };
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+
+    for (size_t i = 0; i < partitions.size(); i++) {
+      if (!partitions[i]->events.empty()) {
+        heads.push({partitions[i]->events[0].timestamp_ms - time_ms, i, 0});
+      }
+    }
+
+    while (!heads.empty()) {
+      Head head = heads.top();
+      heads.pop();
+
+      const std::vector<SimulationEvent> &events =
+          partitions[head.partition]->events;
+      sink(sink_context, events[head.index]);
+
+      // Events of a partition are already in order
+      if (++head.index < events.size()) {
+        head.offset_ms = events[head.index].timestamp_ms - time_ms;
+        heads.push(head);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < partitions.size(); i++) {
+    partitions[i]->events.clear();
+  }
+}
+
+void ParallelSimulator::on_event(void *context,
+                                 const SimulationEvent &event) {
+  Partition *partition = static_cast<Partition *>(context);
+  SimulationEvent global_event = event;
+  global_event.light += partition->first_light;
+  partition->events.push_back(global_event);
+}
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef PARALLEL_SIMULATOR_H
+#define PARALLEL_SIMULATOR_H
+
+#ifndef ARDUINO
+
+#include "simulator.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Simulates large numbers of traffic lights on several threads.
+ * The lights are split into partitions of PARTITION_SIZE lights, each with
+ * its own Simulator and virtual clock. Every thread starts with its own share
+ * of the partitions and steals partitions from the other threads when it
+ * runs out of work. After all partitions reached the time horizon, their
+ * events are merged into the order a single Simulator would produce, so the
+ * event stream does not depend on the number of threads. The threads are
+ * started by the first run and wait for the next merge window in between.
+ *
+ * Lights must be configured before they are added and must not be changed
+ * while the simulation runs. Lights interacting with each other have to be in
+ * the same partition.
+ */
+class ParallelSimulator {
+public:
+  static constexpr int PARTITION_SIZE = 64;
+
+  /**
+   * Constructor for the ParallelSimulator class.
+   * The simulation starts at the current time of the calling thread's
+   * backend.
+   * @param thread_count Number of threads, 0 for one per CPU core.
+   */
+  explicit ParallelSimulator(int thread_count = 0);
+
+  ~ParallelSimulator();
+
+  /**
+   * Adds a light to the simulation.
+   * The light must stay valid while it is in the simulation.
+   * @param light The traffic light.
+   * @return The index of the light in the event stream.
+   */
+  int add(TrafficLight &light);
+
+  /**
+   * Gets the number of lights in the simulation.
+   * @return The number of lights.
+   */
+  int get_count();
+
+  /**
+   * Gets the number of threads running the simulation.
+   * @return The number of threads.
+   */
+  int get_thread_count();
+
+  /**
+   * Gets the virtual time the simulation has reached.
+   * @return The time in milliseconds.
+   */
+  unsigned long get_time_ms();
+
+  /**
+   * Gets the number of events recorded since the simulator was created.
+   * @return The number of events.
+   */
+  unsigned long get_event_count();
+
+  /**
+   * Sets the function receiving the merged events.
+   * It is called on the thread calling run_until().
+   * @param sink The function, nullptr to only count the events.
+   * @param context Passed to the function.
+   */
+  void set_event_sink(void (*sink)(void *context,
+                                   const SimulationEvent &event),
+                      void *context = nullptr);
+
+  /**
+   * Sets how far the partitions run before their events are merged.
+   * Shorter windows use less memory for buffered events.
+   * @param window_ms The window in milliseconds, 0 to run to the end at once.
+   */
+  void set_merge_window(unsigned long window_ms);
+
+  /**
+   * Runs all lights until a point in time.
+   * @param end_ms The virtual time to stop at in milliseconds.
+   */
+  void run_until(unsigned long end_ms);
+
+  /**
+   * Runs all lights for a duration from the current virtual time.
+   * @param duration_ms The duration in milliseconds.
+   */
+  void run_for(unsigned long duration_ms);
+
+private:
+  /**
+   * A group of lights simulated by one thread at a time.
+   */
+  struct Partition {
+    HostBackend clock;
+    Simulator<PARTITION_SIZE> simulator;
+    std::vector<SimulationEvent> events; // Events of the current window
+    int first_light;                     // Index of the first light
+
+    Partition(unsigned long start_ms, int first_light);
+  };
+
+  /**
+   * Partitions a thread owns, taken from the front, also by other threads.
+   */
+  struct WorkRange {
+    std::atomic<int> next;
+    int end;
+  };
+
+  std::vector<Partition *> partitions;
+  WorkRange *ranges;
+  std::vector<std::thread> workers; // Threads besides the calling one
+  std::mutex mutex;
+  std::condition_variable window_started;
+  std::condition_variable window_finished;
+  unsigned long window_count; // Windows started, wakes the workers
+  unsigned long horizon_ms;   // Horizon of the current window
+  int busy_count;             // Workers still running the current window
+  bool stopping;
+  int thread_count;
+  int light_count;
+  unsigned long time_ms;
+  unsigned long window_ms;
+  unsigned long event_count;
+  void (*sink)(void *context, const SimulationEvent &event);
+  void *sink_context;
+
+  // Disable copy constructor and assignment
+  ParallelSimulator(const ParallelSimulator &) = delete;
+  ParallelSimulator &operator=(const ParallelSimulator &) = delete;
+
+  /**
+   * Runs all partitions to a horizon on all threads.
+   * @param horizon_ms The virtual time to stop at in milliseconds.
+   */
+  void run_partitions(unsigned long horizon_ms);
+
+  /**
+   * Runs the windows handed over by run_partitions() until stopped.
+   * @param worker The index of the thread.
+   */
+  void run_worker(int worker);
+
+  /**
+   * Runs partitions until none is left, stealing from other threads.
+   * @param worker The index of the thread.
+   * @param horizon_ms The virtual time to stop at in milliseconds.
+   */
+  void work(int worker, unsigned long horizon_ms);
+
+  /**
+   * Passes the events of all partitions to the sink in order.
+   */
+  void merge_events();
+
+  /**
+   * Buffers an event of a partition.
+   * @param context The partition.
+   * @param event The event.
+   */
+  static void on_event(void *context, const SimulationEvent &event);
+};
+
+#endif
+
+#endif
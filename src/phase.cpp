@@ -0,0 +1,34 @@
+#include "phase.h"
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#endif
+
+void unpack_phase(const PackedPhase *packed, bool in_flash, Phase &phase) {
+  uint8_t bytes[3];
+#if defined(__AVR__)
+  if (in_flash) {
+    const uint8_t *source = reinterpret_cast<const uint8_t *>(packed);
+    bytes[0] = pgm_read_byte(source);
+    bytes[1] = pgm_read_byte(source + 1);
+    bytes[2] = pgm_read_byte(source + 2);
+  } else
+#else
+  (void)in_flash;
+#endif
+  {
+    // Flash is part of the normal address space on other architectures
+    bytes[0] = packed->lamps;
+    bytes[1] = packed->duration[0];
+    bytes[2] = packed->duration[1];
+  }
+
+  uint8_t lamps = bytes[0] & PACKED_PHASE_PATTERN_MASK;
+  phase.pattern[0] = lamps & 0x01;
+  phase.pattern[1] = lamps & 0x02;
+  phase.pattern[2] = lamps & 0x04;
+
+  unsigned long count = bytes[1] | (static_cast<unsigned long>(bytes[2]) << 8);
+  phase.duration_ms =
+      count * get_packed_phase_unit_ms(bytes[0] >> PACKED_PHASE_UNIT_SHIFT);
+}
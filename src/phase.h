@@ -1,9 +1,141 @@
 #ifndef PHASE_H
 #define PHASE_H
 
+#include <stdint.h>
+
+// Longest phase the overflow safe timing can handle (~24 days)
+constexpr unsigned long MAX_PHASE_DURATION_MS = 0x7FFFFFFFUL;
+
 struct Phase {
   bool pattern[3];
   unsigned long duration_ms;
 };
 
-#endif
\ No newline at end of file
+/**
+ * Checks if a phase can be shown: it has a duration within the supported
+ * range and red and green are never on together.
+ * Usable at compile time, e.g. static_assert(is_phase_valid(PHASE), "").
+ * @param phase The phase to check.
+ * @return True if the phase is valid, false otherwise.
+ */
+constexpr bool is_phase_valid(const Phase &phase) {
+  return phase.duration_ms > 0 && phase.duration_ms <= MAX_PHASE_DURATION_MS &&
+         !(phase.pattern[0] && phase.pattern[2]);
+}
+
+/**
+ * Compact phase taking 3 bytes, can be read directly from flash (PROGMEM).
+ * The lower bits of lamps are the pattern (bit 0 red, 1 yellow, 2 green), the
+ * upper two bits select the unit of the duration: 1 ms, 10 ms, 100 ms or 1 s.
+ * Create it with pack_phase() instead of filling the fields directly.
+ */
+struct PackedPhase {
+  uint8_t lamps;
+  uint8_t duration[2]; // Duration in units, little endian
+};
+
+constexpr uint8_t PACKED_PHASE_UNIT_SHIFT = 6;
+constexpr uint8_t PACKED_PHASE_PATTERN_MASK = 0x07;
+
+// Longest phase a packed phase can hold (~18 hours)
+constexpr unsigned long MAX_PACKED_PHASE_DURATION_MS = 65535UL * 1000UL;
+
+/**
+ * Gets the finest unit a duration fits into a packed phase with.
+ * @param duration_ms The duration in milliseconds.
+ * @return The unit index, 0 (1 ms) to 3 (1 s).
+ */
+constexpr uint8_t get_packed_phase_unit(unsigned long duration_ms) {
+  return duration_ms <= 65535UL     ? 0
+         : duration_ms <= 655350UL  ? 1
+         : duration_ms <= 6553500UL ? 2
+                                    : 3;
+}
+
+/**
+ * Gets the length of a packed phase duration unit.
+ * @param unit The unit index, 0 to 3.
+ * @return The length of the unit in milliseconds.
+ */
+constexpr unsigned long get_packed_phase_unit_ms(uint8_t unit) {
+  return unit == 0 ? 1UL : unit == 1 ? 10UL : unit == 2 ? 100UL : 1000UL;
+}
+
+// Number of units stored for a duration, clamped to 16 bits
+constexpr unsigned long get_packed_phase_count(unsigned long duration_ms,
+                                               uint8_t unit) {
+  return duration_ms / get_packed_phase_unit_ms(unit) > 65535UL
+             ? 65535UL
+             : duration_ms / get_packed_phase_unit_ms(unit);
+}
+
+/**
+ * Packs a phase, usable at compile time to fill tables in flash.
+ * Durations above 65.535 s are rounded down to the unit they are stored in,
+ * durations above MAX_PACKED_PHASE_DURATION_MS are clamped.
+ * @param red_light Whether the red light is on.
+ * @param yellow_light Whether the yellow light is on.
+ * @param green_light Whether the green light is on.
+ * @param duration_ms The duration of the phase in milliseconds.
+ * @return The packed phase.
+ */
+constexpr PackedPhase pack_phase(bool red_light, bool yellow_light,
+                                 bool green_light, unsigned long duration_ms) {
+  return PackedPhase{
+      static_cast<uint8_t>(
+          (red_light ? 0x01 : 0) | (yellow_light ? 0x02 : 0) |
+          (green_light ? 0x04 : 0) |
+          (get_packed_phase_unit(duration_ms) << PACKED_PHASE_UNIT_SHIFT)),
+      {static_cast<uint8_t>(
+           get_packed_phase_count(duration_ms,
+                                  get_packed_phase_unit(duration_ms)) &
+           0xFF),
+       static_cast<uint8_t>(
+           get_packed_phase_count(duration_ms,
+                                  get_packed_phase_unit(duration_ms)) >>
+           8)}};
+}
+
+/**
+ * Gets the duration of a packed phase in RAM.
+ * @param phase The packed phase.
+ * @return The duration in milliseconds.
+ */
+constexpr unsigned long get_packed_phase_duration_ms(const PackedPhase &phase) {
+  return (static_cast<unsigned long>(phase.duration[0]) |
+          (static_cast<unsigned long>(phase.duration[1]) << 8)) *
+         get_packed_phase_unit_ms(phase.lamps >> PACKED_PHASE_UNIT_SHIFT);
+}
+
+/**
+ * Checks if a packed phase can be shown, see is_phase_valid().
+ * @param phase The packed phase to check.
+ * @return True if the phase is valid, false otherwise.
+ */
+constexpr bool is_phase_valid(const PackedPhase &phase) {
+  return get_packed_phase_duration_ms(phase) > 0 &&
+         (phase.lamps & 0x05) != 0x05;
+}
+
+/**
+ * Unpacks a packed phase.
+ * @param packed The packed phase.
+ * @param in_flash True if the packed phase is stored in flash (PROGMEM).
+ * @param phase Set to the unpacked phase.
+ */
+void unpack_phase(const PackedPhase *packed, bool in_flash, Phase &phase);
+
+/**
+ * Checks if all phases of a table are valid, see is_phase_valid().
+ * Usable at compile time, e.g. static_assert(are_phases_valid(PHASES), "").
+ * @param phases The phase table.
+ * @param index The first phase to check.
+ * @return True if all phases are valid, false otherwise.
+ */
+template <typename T, int N>
+constexpr bool are_phases_valid(const T (&phases)[N], int index = 0) {
+  return index >= N ||
+         (is_phase_valid(phases[index]) && are_phases_valid(phases, index + 1));
+}
+
+#endif
@@ -0,0 +1,122 @@
+#include "phase_effect.h"
+#include "hal.h"
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#elif !defined(PROGMEM)
+#define PROGMEM
+#endif
+
+// round(255 * (i / 63) ^ 2.2)
+const uint8_t GAMMA_CURVE[BRIGHTNESS_STEPS] PROGMEM = {
+    0,   0,   0,   0,   1,   1,   1,   2,   3,   4,   4,   5,   7,
+    8,   9,   11,  13,  14,  16,  18,  20,  23,  25,  28,  31,  33,
+    36,  40,  43,  46,  50,  54,  57,  61,  66,  70,  74,  79,  84,
+    89,  94,  99,  105, 110, 116, 122, 128, 134, 140, 147, 153, 160,
+    167, 174, 182, 189, 197, 205, 213, 221, 229, 238, 246, 255};
+
+namespace {
+
+// Shift dividing a ramp into BRIGHTNESS_STEPS parts
+constexpr uint8_t STEP_SHIFT = 6;
+static_assert((1 << STEP_SHIFT) == BRIGHTNESS_STEPS,
+              "Brightness steps must match the shift");
+
+uint8_t read_curve(const uint8_t *curve, uint8_t step) {
+  if (curve == nullptr) {
+    // Linear, maps 0..63 to 0..255
+    return (step << 2) | (step >> 4);
+  }
+#if defined(__AVR__)
+  return pgm_read_byte(curve + step);
+#else
+  return curve[step];
+#endif
+}
+
+} // namespace
+
+EffectPlayer::EffectPlayer()
+    : effect(nullptr), start_ms(0), next_ms(0), step(0), flash_on(true) {}
+
+bool EffectPlayer::is_flashing() {
+  return effect->on_ms > 0 && effect->on_ms < effect->period_ms;
+}
+
+unsigned long EffectPlayer::get_step_time(uint8_t step) {
+  return start_ms +
+         ((static_cast<unsigned long>(step) * effect->period_ms) >> STEP_SHIFT);
+}
+
+void EffectPlayer::start(const PhaseEffect *effect, unsigned long start_ms) {
+  this->effect = effect;
+  this->start_ms = start_ms;
+  step = 0;
+  if (effect == nullptr)
+    return;
+
+  if (effect->type == LampEffect::FLASH) {
+    flash_on = effect->on_ms > 0;
+    next_ms = start_ms + effect->on_ms;
+  } else {
+    next_ms = get_step_time(1);
+  }
+}
+
+void EffectPlayer::stop() { effect = nullptr; }
+
+void EffectPlayer::update(unsigned long now) {
+  if (effect == nullptr || !hal::time_reached(now, next_ms))
+    return;
+
+  if (effect->type != LampEffect::FLASH) {
+    while (step < BRIGHTNESS_STEPS - 1 && hal::time_reached(now, next_ms)) {
+      step++;
+      next_ms = get_step_time(step + 1);
+    }
+    return;
+  }
+
+  if (!is_flashing())
+    return;
+
+  // Skip whole periods at once after a long pause, the state is the same
+  unsigned long late_ms = now - next_ms;
+  if (late_ms >= effect->period_ms) {
+    next_ms += late_ms - late_ms % effect->period_ms;
+  }
+  while (hal::time_reached(now, next_ms)) {
+    flash_on = !flash_on;
+    next_ms += flash_on ? effect->on_ms : effect->period_ms - effect->on_ms;
+  }
+}
+
+uint8_t EffectPlayer::get_mask(uint8_t mask) {
+  if (effect == nullptr || effect->type != LampEffect::FLASH || flash_on)
+    return mask;
+  return mask & ~effect->lamps;
+}
+
+uint8_t EffectPlayer::get_pwm_mask(uint8_t mask) {
+  if (effect == nullptr || effect->type == LampEffect::FLASH)
+    return 0;
+  return mask & effect->lamps;
+}
+
+uint8_t EffectPlayer::get_level() {
+  if (effect == nullptr || effect->type == LampEffect::FLASH)
+    return 255;
+  uint8_t position =
+      effect->type == LampEffect::FADE_IN ? step : BRIGHTNESS_STEPS - 1 - step;
+  return read_curve(effect->curve, position);
+}
+
+bool EffectPlayer::get_next_deadline(unsigned long &deadline_ms) {
+  if (effect == nullptr)
+    return false;
+  if (effect->type == LampEffect::FLASH ? !is_flashing()
+                                        : step >= BRIGHTNESS_STEPS - 1)
+    return false;
+  deadline_ms = next_ms;
+  return true;
+}
@@ -0,0 +1,121 @@
+#ifndef PHASE_EFFECT_H
+#define PHASE_EFFECT_H
+
+#include <stdint.h>
+
+// Number of levels of a brightness curve
+constexpr int BRIGHTNESS_STEPS = 64;
+
+/**
+ * Brightness curve correcting for the eye (gamma 2.2), so fades look even.
+ * Stored in flash (PROGMEM) on AVR boards.
+ */
+extern const uint8_t GAMMA_CURVE[BRIGHTNESS_STEPS];
+
+enum class LampEffect : uint8_t {
+  FLASH,    // Lamps turn on and off, e.g. flashing yellow at night
+  FADE_IN,  // Lamps ramp up to full brightness with PWM
+  FADE_OUT, // Lamps ramp down to off with PWM
+};
+
+/**
+ * Makes lamps of a phase of a cycle flash or fade instead of being steadily
+ * on. Only lamps that are on in the pattern of the phase are affected.
+ * Fades need PWM capable pins and do not work with port output, where the
+ * lamps stay on/off.
+ */
+struct PhaseEffect {
+  int phase_index;
+  uint8_t lamps;        // Bit i set for light i (0: red, 1: yellow, 2: green)
+  LampEffect type;
+  uint16_t period_ms;   // FLASH: one on/off period, FADE_*: the ramp time
+  uint16_t on_ms;       // FLASH: on time per period, unused by fades
+  const uint8_t *curve; // BRIGHTNESS_STEPS levels in flash, nullptr: linear
+};
+
+/**
+ * Plays the effect of the current phase.
+ * The effect advances from one precomputed point in time to the next, so
+ * an update only compares times; curves are looked up in integer tables.
+ */
+class EffectPlayer {
+private:
+  const PhaseEffect *effect; // nullptr if no effect is playing
+  unsigned long start_ms;
+  unsigned long next_ms; // Next toggle or brightness step
+  uint8_t step;          // Brightness step of a fade
+  bool flash_on;
+
+  // Disable copy constructor and assignment
+  EffectPlayer(const EffectPlayer &) = delete;
+  EffectPlayer &operator=(const EffectPlayer &) = delete;
+
+  /**
+   * Checks if a flashing effect toggles at all.
+   */
+  bool is_flashing();
+
+  /**
+   * Gets the point in time a brightness step of the fade starts.
+   */
+  unsigned long get_step_time(uint8_t step);
+
+public:
+  EffectPlayer();
+  ~EffectPlayer() = default;
+
+  /**
+   * Checks if an effect is playing.
+   * @return True if an effect is playing, false otherwise.
+   */
+  bool is_playing() { return effect != nullptr; }
+
+  /**
+   * Starts playing an effect.
+   * @param effect The effect, must stay valid while it is played. nullptr to
+   * stop playing.
+   * @param start_ms The start of the phase in milliseconds.
+   */
+  void start(const PhaseEffect *effect, unsigned long start_ms);
+
+  /**
+   * Stops playing, the lamps are steadily on again.
+   */
+  void stop();
+
+  /**
+   * Advances the effect to a point in time.
+   * @param now The current time in milliseconds.
+   */
+  void update(unsigned long now);
+
+  /**
+   * Gets the lamps to turn on.
+   * @param mask The lamps of the phase, bit i set for light i.
+   * @return The lamps to turn on, lamps in get_pwm_mask() are left as they
+   * are.
+   */
+  uint8_t get_mask(uint8_t mask);
+
+  /**
+   * Gets the lamps dimmed with PWM.
+   * @param mask The lamps of the phase, bit i set for light i.
+   * @return The dimmed lamps.
+   */
+  uint8_t get_pwm_mask(uint8_t mask);
+
+  /**
+   * Gets the brightness of the dimmed lamps.
+   * @return The PWM duty cycle, 0 to 255.
+   */
+  uint8_t get_level();
+
+  /**
+   * Gets the point in time the output next changes.
+   * @param deadline_ms Set to the deadline in milliseconds.
+   * @return True if the output changes, false if it stays as it is.
+   */
+  bool get_next_deadline(unsigned long &deadline_ms);
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include "phase_source.h"
+
+PhaseStreamBase::PhaseStreamBase(Phase *buffer, int capacity)
+    : source(nullptr), buffer(buffer), capacity(capacity), phase_count(0),
+      first_index(0), first_slot(0), count(0), miss_count(0) {}
+
+void PhaseStreamBase::set_source(PhaseSource *source) {
+  this->source = source;
+  phase_count = (source != nullptr) ? source->get_phase_count() : 0;
+  first_index = 0;
+  first_slot = 0;
+  count = 0;
+}
+
+int PhaseStreamBase::get_phase_count() { return phase_count; }
+
+int PhaseStreamBase::get_buffered_count() { return count; }
+
+unsigned long PhaseStreamBase::get_miss_count() { return miss_count; }
+
+bool PhaseStreamBase::get_phase(int index, Phase &phase) {
+  if (index < 0 || index >= phase_count)
+    return false;
+
+  // Distance from the first buffered phase, wrapping around the schedule
+  int offset = index - first_index;
+  if (offset < 0) {
+    offset += phase_count;
+  }
+
+  if (offset < count) {
+    // Drop the phases before it
+    first_index = index;
+    first_slot = (first_slot + offset) % capacity;
+    count -= offset;
+  } else {
+    // Not buffered, read it now and buffer ahead from there
+    miss_count++;
+    first_index = index;
+    first_slot = 0;
+    count = 0;
+    if (source->read_phases(index, &buffer[0], 1) != 1)
+      return false;
+    count = 1;
+  }
+
+  phase = buffer[first_slot];
+  return true;
+}
+
+bool PhaseStreamBase::peek_phase(int index, Phase &phase) {
+  if (index < 0 || index >= phase_count)
+    return false;
+
+  int offset = index - first_index;
+  if (offset < 0) {
+    offset += phase_count;
+  }
+
+  if (offset < count) {
+    phase = buffer[(first_slot + offset) % capacity];
+    return true;
+  }
+
+  miss_count++;
+  return source->read_phases(index, &phase, 1) == 1;
+}
+
+int PhaseStreamBase::refill(int max_count) {
+  int read_count = 0;
+
+  while (count < capacity && (max_count == 0 || read_count < max_count)) {
+    // A schedule shorter than the buffer is read once
+    if (count >= phase_count)
+      break;
+
+    // Read the longest run that is consecutive in the source and the buffer
+    int index = (first_index + count) % phase_count;
+    int slot = (first_slot + count) % capacity;
+    int run = capacity - count;
+    if (run > phase_count - index) {
+      run = phase_count - index;
+    }
+    if (run > capacity - slot) {
+      run = capacity - slot;
+    }
+    if (max_count > 0 && run > max_count - read_count) {
+      run = max_count - read_count;
+    }
+
+    int result = source->read_phases(index, &buffer[slot], run);
+    if (result > 0) {
+      count += result;
+      read_count += result;
+    }
+    if (result < run)
+      break; // Source failed, try again on the next refill
+  }
+
+  return read_count;
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+#ifndef PHASE_SOURCE_H
+#define PHASE_SOURCE_H
+
+#include "phase.h"
+
+/**
+ * Storage holding the phases of a cycle outside of RAM, e.g. on an SD card,
+ * in external flash or in a file. Phases are read by index, so a source can
+ * hold schedules of any length.
+ */
+class PhaseSource {
+public:
+  virtual ~PhaseSource() = default;
+
+  /**
+   * Gets the number of phases in the source.
+   * @return The number of phases.
+   */
+  virtual int get_phase_count() = 0;
+
+  /**
+   * Reads consecutive phases.
+   * @param index The index of the first phase.
+   * @param phases The buffer to read into.
+   * @param count The number of phases to read.
+   * @return The number of phases read, less than count on errors.
+   */
+  virtual int read_phases(int index, Phase *phases, int count) = 0;
+};
+
+/**
+ * Read-ahead buffer streaming the phases of a PhaseSource into a cycle.
+ * The buffer holds the current phase and the phases following it, wrapping
+ * around to the first phase at the end of the schedule. refill() reads the
+ * next phases ahead of time, so the cycle changes phases without waiting
+ * for the storage. If a phase is not buffered when it is needed, e.g. because
+ * refill() was not called in time, it is read directly from the source.
+ *
+ * Use the PhaseStream template to get a buffer with its storage
+ */
+class PhaseStreamBase {
+public:
+  /**
+   * Sets the source to stream from and drops all buffered phases.
+   * @param source The source, must stay valid while it is used. nullptr to
+   * stream no phases.
+   */
+  void set_source(PhaseSource *source);
+
+  /**
+   * Gets the number of phases in the source.
+   * @return The number of phases, 0 without a source.
+   */
+  int get_phase_count();
+
+  /**
+   * Gets the number of buffered phases, starting with the current one.
+   * @return The number of phases.
+   */
+  int get_buffered_count();
+
+  /**
+   * Gets the number of phases read directly from the source because they
+   * were not buffered.
+   * @return The number of misses.
+   */
+  unsigned long get_miss_count();
+
+  /**
+   * Gets a phase, making it the current one. Phases before it are dropped
+   * from the buffer.
+   * @param index The index of the phase.
+   * @param phase Set to the phase.
+   * @return True if the phase was read, false if the source failed.
+   */
+  bool get_phase(int index, Phase &phase);
+
+  /**
+   * Gets a phase without dropping buffered phases, e.g. to look ahead.
+   * A phase that is not buffered is read directly from the source.
+   * @param index The index of the phase.
+   * @param phase Set to the phase.
+   * @return True if the phase was read, false if the source failed.
+   */
+  bool peek_phase(int index, Phase &phase);
+
+  /**
+   * Reads phases following the buffered ones from the source until the
+   * buffer is full. Call it from loop() or whenever there is time, not from
+   * an interrupt. If the cycle is updated by an InterruptTimer, call it only
+   * between the timer's lock() and unlock(), as the timer takes phases from
+   * the buffer; read a few phases at a time to keep the timer waiting short.
+   * @param max_count The maximum number of phases to read, 0 to fill the
+   * buffer.
+   * @return The number of phases read.
+   */
+  int refill(int max_count = 0);
+
+protected:
+  PhaseStreamBase(Phase *buffer, int capacity);
+
+private:
+  PhaseSource *source;
+  Phase *buffer;
+  int capacity;
+  int phase_count; // Phases in the source
+  int first_index; // Index of the first buffered phase
+  int first_slot;  // Slot of the first buffered phase in the buffer
+  int count;       // Number of buffered phases
+  unsigned long miss_count;
+
+  // Disable copy constructor and assignment
+  PhaseStreamBase(const PhaseStreamBase &) = delete;
+  PhaseStreamBase &operator=(const PhaseStreamBase &) = delete;
+};
+
+/**
+ * Phase stream buffering up to a fixed number of phases
+ */
+template <int CAPACITY> class PhaseStream : public PhaseStreamBase {
+  static_assert(CAPACITY > 0, "Capacity must be positive");
+
+private:
+  Phase phases[CAPACITY];
+
+public:
+  PhaseStream() : PhaseStreamBase(phases, CAPACITY) {}
+  explicit PhaseStream(PhaseSource &source) : PhaseStream() {
+    set_source(&source);
+  }
+};
+
+#endif
\ No newline at end of file
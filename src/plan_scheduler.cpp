@@ -0,0 +1,61 @@
+#include "plan_scheduler.h"
+#include "hal.h"
+
+PlanScheduler::PlanScheduler(const Plan *plans, int plan_count,
+                             const PlanEntry *entries, int entry_count,
+                             unsigned long period_s)
+    : plans(plans), plan_count(plan_count), entries(entries),
+      entry_count(entry_count), period_s(period_s > 0 ? period_s : 1),
+      reference_s(0), reference_ms(0) {}
+
+unsigned long PlanScheduler::get_time_s() {
+  unsigned long elapsed_ms = hal::millis() - reference_ms;
+
+  // Move the reference along whole periods, so millis() may wrap around
+  unsigned long period_ms = period_s * 1000UL;
+  if (elapsed_ms >= period_ms) {
+    unsigned long periods_ms = (elapsed_ms / period_ms) * period_ms;
+    reference_ms += periods_ms;
+    elapsed_ms -= periods_ms;
+  }
+
+  return (reference_s + elapsed_ms / 1000UL) % period_s;
+}
+
+int PlanScheduler::find_entry(unsigned long time_s) {
+  if (entry_count <= 0)
+    return -1;
+
+  // Find the first entry starting after the time
+  int low = 0;
+  int high = entry_count;
+  while (low < high) {
+    int middle = low + (high - low) / 2;
+    if (entries[middle].start_s <= time_s) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  // Before the first entry the last one of the previous period runs
+  return (low > 0) ? low - 1 : entry_count - 1;
+}
+
+int PlanScheduler::get_plan_index() {
+  int entry = find_entry(get_time_s());
+  if (entry < 0 || entries[entry].plan_index >= plan_count)
+    return -1;
+  return entries[entry].plan_index;
+}
+
+const Plan *PlanScheduler::get_plan(int index) {
+  if (index < 0 || index >= plan_count)
+    return nullptr;
+  return &plans[index];
+}
+
+void PlanScheduler::set_time_s(unsigned long time_s) {
+  reference_s = time_s % period_s;
+  reference_ms = hal::millis();
+}
\ No newline at end of file
@@ -0,0 +1,125 @@
+#ifndef PLAN_SCHEDULER_H
+#define PLAN_SCHEDULER_H
+
+#include "phase.h"
+#include <stdint.h>
+
+constexpr unsigned long SECONDS_PER_DAY = 86400UL;
+constexpr unsigned long SECONDS_PER_WEEK = 7UL * SECONDS_PER_DAY;
+
+/**
+ * Phases of a signal program, e.g. for the morning peak or the night.
+ */
+struct Plan {
+  const Phase *phases; // Must stay valid while the plan is used
+  int phase_count;
+};
+
+/**
+ * Entry of a timetable: from start_s on the plan with plan_index runs until
+ * the next entry starts.
+ */
+struct PlanEntry {
+  unsigned long start_s; // Time within the day or week in seconds
+  uint8_t plan_index;
+};
+
+/**
+ * Gets the time of a timetable entry.
+ * @param hour The hour, 0 to 23.
+ * @param minute The minute, 0 to 59.
+ * @param day The day of the week starting with 0, 0 for daily timetables.
+ * @return The time within the day or week in seconds.
+ */
+constexpr unsigned long plan_time_s(uint8_t hour, uint8_t minute,
+                                    uint8_t day = 0) {
+  return day * SECONDS_PER_DAY + hour * 3600UL + minute * 60UL;
+}
+
+/**
+ * Checks if the entries of a timetable are sorted by their start time.
+ * Usable at compile time, e.g. static_assert(is_timetable_sorted(TABLE), "").
+ * @param entries The timetable.
+ * @param index The first entry to check.
+ * @return True if the entries are sorted, false otherwise.
+ */
+template <int N>
+constexpr bool is_timetable_sorted(const PlanEntry (&entries)[N],
+                                   int index = 1) {
+  return index >= N || (entries[index - 1].start_s < entries[index].start_s &&
+                        is_timetable_sorted(entries, index + 1));
+}
+
+/**
+ * Selects a plan by the time of day or week from a sorted timetable.
+ * The timetable repeats every period, the plan of its last entry runs until
+ * the first entry of the next period. Plans and timetable are used in place,
+ * nothing is copied or allocated. Attach the scheduler to traffic lights
+ * with TrafficLight::set_plan_scheduler(), they switch plans at the end of
+ * their cycles.
+ *
+ * There is no real-time clock in the library: set the time with set_time_s()
+ * on startup, e.g. from an RTC, and now and then to correct drift of millis().
+ */
+class PlanScheduler {
+private:
+  const Plan *plans;
+  int plan_count;
+  const PlanEntry *entries;
+  int entry_count;
+  unsigned long period_s;
+  unsigned long reference_s;  // Time within the period at reference_ms
+  unsigned long reference_ms; // Point in time reference_s was set
+
+  // Disable copy constructor and assignment
+  PlanScheduler(const PlanScheduler &) = delete;
+  PlanScheduler &operator=(const PlanScheduler &) = delete;
+
+public:
+  /**
+   * Constructor for the PlanScheduler class.
+   * @param plans The plans, must stay valid while the scheduler is used.
+   * @param plan_count The number of plans.
+   * @param entries The timetable sorted by start time, must stay valid while
+   * the scheduler is used.
+   * @param entry_count The number of entries.
+   * @param period_s The length of the timetable, SECONDS_PER_DAY or
+   * SECONDS_PER_WEEK.
+   */
+  PlanScheduler(const Plan *plans, int plan_count, const PlanEntry *entries,
+                int entry_count, unsigned long period_s = SECONDS_PER_DAY);
+
+  /**
+   * Gets the current time within the period.
+   * @return The time in seconds.
+   */
+  unsigned long get_time_s();
+
+  /**
+   * Finds the timetable entry running at a time by binary search.
+   * @param time_s The time within the period in seconds.
+   * @return The index of the entry, -1 if the timetable is empty.
+   */
+  int find_entry(unsigned long time_s);
+
+  /**
+   * Gets the plan to run now.
+   * @return The index of the plan, -1 if there is none.
+   */
+  int get_plan_index();
+
+  /**
+   * Gets a plan.
+   * @param index The index of the plan.
+   * @return The plan, nullptr if the index is out of range.
+   */
+  const Plan *get_plan(int index);
+
+  /**
+   * Sets the current time within the period.
+   * @param time_s The time in seconds, e.g. plan_time_s(7, 30, 2).
+   */
+  void set_time_s(unsigned long time_s);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,206 @@
+#if !defined(ARDUINO) && defined(__linux__)
+
+#include "shared_state_table.h"
+#include "traffic_light.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint8_t TABLE_VERSION = 1;
+constexpr char TABLE_MAGIC[3] = {'T', 'L', 'M'};
+
+size_t get_table_size(uint16_t slot_count) {
+  return sizeof(SharedStateHeader) + slot_count * sizeof(SharedStateSlot);
+}
+
+} // namespace
+
+// SharedStateTableBase
+SharedStateTableBase::SharedStateTableBase(TrafficLight **lights,
+                                           uint16_t capacity)
+    : lights(lights), capacity(capacity), fd(-1), slots(nullptr), size(0) {
+  for (uint16_t i = 0; i < capacity; i++) {
+    lights[i] = nullptr;
+  }
+}
+
+SharedStateTableBase::~SharedStateTableBase() {
+  for (uint16_t i = 0; i < capacity; i++) {
+    if (lights[i] != nullptr) {
+      lights[i]->set_state_publisher(nullptr, -1);
+    }
+  }
+  close();
+}
+
+bool SharedStateTableBase::open(const char *path) {
+  close();
+
+  // Replace the file, so readers of an old table never see it shrink
+  unlink(path);
+  fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return false;
+
+  size = get_table_size(capacity);
+  void *memory = MAP_FAILED;
+  if (ftruncate(fd, size) == 0) {
+    memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (memory == MAP_FAILED) {
+    close();
+    return false;
+  }
+
+  // The file is zeroed, so all slots are unused
+  SharedStateHeader *header = static_cast<SharedStateHeader *>(memory);
+  memcpy(header->magic, TABLE_MAGIC, sizeof(TABLE_MAGIC));
+  header->slot_count = capacity;
+  header->slot_size = sizeof(SharedStateSlot);
+  header->version = TABLE_VERSION;
+  slots = reinterpret_cast<SharedStateSlot *>(header + 1);
+  return true;
+}
+
+void SharedStateTableBase::close() {
+  if (slots != nullptr) {
+    munmap(reinterpret_cast<SharedStateHeader *>(slots) - 1, size);
+    slots = nullptr;
+  }
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+  size = 0;
+}
+
+bool SharedStateTableBase::is_open() { return slots != nullptr; }
+
+int SharedStateTableBase::add(TrafficLight &light) {
+  for (uint16_t i = 0; i < capacity; i++) {
+    if (lights[i] == nullptr) {
+      lights[i] = &light;
+      light.set_state_publisher(this, i);
+      return i;
+    }
+  }
+  return -1;
+}
+
+void SharedStateTableBase::remove(TrafficLight &light) {
+  for (uint16_t i = 0; i < capacity; i++) {
+    if (lights[i] == &light) {
+      lights[i] = nullptr;
+      light.set_state_publisher(nullptr, -1);
+    }
+  }
+}
+
+void SharedStateTableBase::publish(int slot, const SharedLightState &state) {
+  if (slots == nullptr || slot < 0 || slot >= capacity)
+    return;
+
+  // Only this process writes the table, so the slot can be read as is
+  SharedStateSlot &target = slots[slot];
+  if (memcmp(&target.state, &state, sizeof(state)) == 0)
+    return;
+
+  uint32_t sequence = target.sequence.load(std::memory_order_relaxed);
+  target.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  target.state = state;
+  target.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+// SharedStateReader
+SharedStateReader::SharedStateReader()
+    : fd(-1), slots(nullptr), size(0), slot_count(0) {}
+
+SharedStateReader::~SharedStateReader() { close(); }
+
+bool SharedStateReader::open(const char *path) {
+  close();
+
+  fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 ||
+      static_cast<size_t>(info.st_size) < sizeof(SharedStateHeader)) {
+    close();
+    return false;
+  }
+
+  size = info.st_size;
+  void *memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (memory == MAP_FAILED) {
+    close();
+    return false;
+  }
+  slots = reinterpret_cast<const SharedStateSlot *>(
+      static_cast<const SharedStateHeader *>(memory) + 1);
+
+  const SharedStateHeader *header =
+      static_cast<const SharedStateHeader *>(memory);
+  if (memcmp(header->magic, TABLE_MAGIC, sizeof(TABLE_MAGIC)) != 0 ||
+      header->version != TABLE_VERSION ||
+      header->slot_size != sizeof(SharedStateSlot) ||
+      get_table_size(header->slot_count) > size) {
+    close();
+    return false;
+  }
+
+  slot_count = header->slot_count;
+  return true;
+}
+
+void SharedStateReader::close() {
+  if (slots != nullptr) {
+    munmap(const_cast<SharedStateHeader *>(
+               reinterpret_cast<const SharedStateHeader *>(slots) - 1),
+           size);
+    slots = nullptr;
+  }
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+  size = 0;
+  slot_count = 0;
+}
+
+bool SharedStateReader::is_open() { return slots != nullptr; }
+
+int SharedStateReader::get_slot_count() { return slot_count; }
+
+uint32_t SharedStateReader::get_change_count(int slot) {
+  if (slots == nullptr || slot < 0 || slot >= slot_count)
+    return 0;
+  return slots[slot].sequence.load(std::memory_order_acquire) / 2;
+}
+
+bool SharedStateReader::read(int slot, SharedLightState &state) {
+  if (slots == nullptr || slot < 0 || slot >= slot_count)
+    return false;
+
+  const SharedStateSlot &source = slots[slot];
+  for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++) {
+    uint32_t sequence = source.sequence.load(std::memory_order_acquire);
+    if (sequence & 1)
+      continue; // Being written
+
+    memcpy(&state, &source.state, sizeof(state));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (source.sequence.load(std::memory_order_relaxed) == sequence)
+      return true;
+  }
+  return false;
+}
+
+#endif
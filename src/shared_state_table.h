@@ -0,0 +1,185 @@
+#ifndef SHARED_STATE_TABLE_H
+#define SHARED_STATE_TABLE_H
+
+#if !defined(ARDUINO) && defined(__linux__)
+
+#include "state_publisher.h"
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+class TrafficLight;
+
+/**
+ * Header at the start of a shared state table.
+ * The table starts with "TLM" and a version byte, followed by the number
+ * of slots and the size of a slot, all in host byte order.
+ */
+struct SharedStateHeader {
+  char magic[3];
+  uint8_t version;
+  uint16_t slot_count;
+  uint16_t slot_size;
+};
+
+/**
+ * Slot of a traffic light in a shared state table, protected by a seqlock:
+ * the sequence is odd while the state is written and grows by 2 with every
+ * change.
+ */
+struct SharedStateSlot {
+  std::atomic<uint32_t> sequence;
+  SharedLightState state;
+};
+
+static_assert(sizeof(SharedStateHeader) == 8 && sizeof(SharedStateSlot) == 20,
+              "Shared state table must have a fixed layout");
+static_assert(ATOMIC_INT_LOCK_FREE == 2,
+              "Sequences must be lock-free to be shared between processes");
+
+/**
+ * Publishes the state of traffic lights into a memory mapped file on Linux,
+ * so monitoring processes can read it with SharedStateReader without any
+ * calls into this process. A light writes its slot only when its state
+ * changed, which costs a comparison per update() otherwise. Readers never
+ * block the lights: a reader that overlaps a write simply reads again.
+ * Use a file in /dev/shm to keep the table in memory only.
+ * The lights must be updated from one thread at a time.
+ *
+ * Use the SharedStateTable template to get a table with its storage
+ */
+class SharedStateTableBase : public StatePublisher {
+private:
+  TrafficLight **lights;
+  uint16_t capacity;
+  int fd;
+  SharedStateSlot *slots; // nullptr if no file is open
+  size_t size;            // Size of the mapping in bytes
+
+  // Disable copy constructor and assignment
+  SharedStateTableBase(const SharedStateTableBase &) = delete;
+  SharedStateTableBase &operator=(const SharedStateTableBase &) = delete;
+
+protected:
+  SharedStateTableBase(TrafficLight **lights, uint16_t capacity);
+
+public:
+  ~SharedStateTableBase() override;
+
+  /**
+   * Creates the table file and maps it, closing the previous one. An
+   * existing file is replaced, readers of it have to open the table again.
+   * Lights already added publish their state on their next update().
+   * @param path The path of the file, e.g. "/dev/shm/traffic_lights".
+   * @return True if the table was created, false otherwise.
+   */
+  bool open(const char *path);
+
+  /**
+   * Unmaps the table file, the file itself is kept.
+   */
+  void close();
+
+  /**
+   * Checks if a table file is open.
+   * @return True if a file is open, false otherwise.
+   */
+  bool is_open();
+
+  /**
+   * Adds a traffic light to the next free slot and publishes its state.
+   * @param light The traffic light, must stay valid while it is added.
+   * @return The slot of the light, -1 if the table is full.
+   */
+  int add(TrafficLight &light);
+
+  /**
+   * Removes a traffic light, its slot keeps the last published state.
+   * @param light The traffic light.
+   */
+  void remove(TrafficLight &light) override;
+
+  void publish(int slot, const SharedLightState &state) override;
+};
+
+template <int SLOTS = 16>
+class SharedStateTable : public SharedStateTableBase {
+  static_assert(SLOTS > 0 && SLOTS <= 0xFFFF,
+                "Slots must be between 1 and 65535");
+
+private:
+  TrafficLight *lights[SLOTS];
+
+public:
+  SharedStateTable() : SharedStateTableBase(lights, SLOTS) {}
+};
+
+/**
+ * Reads the states published by a SharedStateTable, e.g. in a dashboard or
+ * logger process. Reads are copies from shared memory without system calls
+ * and never slow down the publishing process.
+ */
+class SharedStateReader {
+private:
+  // Attempts to read a slot that is written at the same time
+  static constexpr int MAX_READ_ATTEMPTS = 64;
+
+  int fd;
+  const SharedStateSlot *slots; // nullptr if no file is open
+  size_t size;                  // Size of the mapping in bytes
+  uint16_t slot_count;
+
+  // Disable copy constructor and assignment
+  SharedStateReader(const SharedStateReader &) = delete;
+  SharedStateReader &operator=(const SharedStateReader &) = delete;
+
+public:
+  SharedStateReader();
+  ~SharedStateReader();
+
+  /**
+   * Opens and maps a table file read-only, closing the previous one.
+   * @param path The path of the file.
+   * @return True if the file holds a valid table, false otherwise.
+   */
+  bool open(const char *path);
+
+  /**
+   * Unmaps the table file.
+   */
+  void close();
+
+  /**
+   * Checks if a table file is open.
+   * @return True if a file is open, false otherwise.
+   */
+  bool is_open();
+
+  /**
+   * Gets the number of slots of the table.
+   * @return The number of slots, 0 if no file is open.
+   */
+  int get_slot_count();
+
+  /**
+   * Gets the number of changes of a slot, e.g. to poll for changes without
+   * copying the state.
+   * @param slot The slot.
+   * @return The number of published changes, 0 for unused slots.
+   */
+  uint32_t get_change_count(int slot);
+
+  /**
+   * Reads a consistent copy of the state of a slot.
+   * @param slot The slot.
+   * @param state Set to the state.
+   * @return True if the state was read, false if the slot is invalid or
+   * kept being written while reading.
+   */
+  bool read(int slot, SharedLightState &state);
+};
+
+#endif
+
+#endif
@@ -0,0 +1,234 @@
+#include "signal_head.h"
+#include "hal.h"
+#include "instrumentation.h"
+
+SignalHeadBase::SignalHeadBase(const int *pins, uint8_t lamp_count,
+                               DefectMonitorBase &defect_monitor)
+    : pins(pins), lamp_count(lamp_count), flags(1 << FLAG_AUTO_LIGHTS_OFF),
+      pattern(0), written_pattern(0), phase_table(nullptr),
+      read_phase(nullptr), phase_count(0), phase_index(0), phase_start_ms(0),
+      phase_duration_ms(0), repetitions_limit(0), repetitions_count(0),
+      event_manager(), defect_monitor(defect_monitor) {}
+
+void SignalHeadBase::begin() {
+  for (int i = 0; i < lamp_count; i++) {
+    hal::pin_mode(pins[i], PinMode::OUTPUT_MODE);
+    hal::digital_write(pins[i], false);
+  }
+}
+
+// getters
+int SignalHeadBase::get_lamp_count() { return lamp_count; }
+
+uint32_t SignalHeadBase::get_pattern() { return pattern; }
+
+bool SignalHeadBase::is_cycle_enabled() { return flags & (1 << FLAG_ENABLED); }
+
+int SignalHeadBase::get_phase_index() {
+  return is_cycle_enabled() ? phase_index : -1;
+}
+
+bool SignalHeadBase::get_next_deadline(unsigned long &deadline_ms) {
+  // Pattern set but not written yet
+  if (pattern != written_pattern) {
+    deadline_ms = hal::millis();
+    return true;
+  }
+
+  bool found = false;
+  if (is_cycle_enabled()) {
+    deadline_ms = phase_start_ms + phase_duration_ms;
+    found = true;
+  }
+
+  unsigned long test_deadline_ms;
+  if (defect_monitor.get_next_deadline(test_deadline_ms)) {
+    deadline_ms =
+        found ? hal::earliest(deadline_ms, test_deadline_ms) : test_deadline_ms;
+    found = true;
+  }
+
+  return found;
+}
+
+bool SignalHeadBase::is_lamp_intact(int lamp) {
+  return defect_monitor.is_intact(lamp);
+}
+
+// setters
+void SignalHeadBase::set_pattern(uint32_t lamps) {
+  uint32_t lamps_mask =
+      (lamp_count < 32) ? (1UL << lamp_count) - 1 : 0xFFFFFFFFUL;
+  pattern = lamps & lamps_mask;
+}
+
+void SignalHeadBase::set_lamp(int lamp, bool on) {
+  if (lamp < 0 || lamp >= lamp_count)
+    return;
+  if (on) {
+    pattern |= (1UL << lamp);
+  } else {
+    pattern &= ~(1UL << lamp);
+  }
+}
+
+void SignalHeadBase::set_test_pin(int lamp, int pin) {
+  defect_monitor.set_pin(lamp, pin);
+}
+
+void SignalHeadBase::set_defect_threshold(int threshold) {
+  defect_monitor.set_threshold(threshold);
+}
+
+void SignalHeadBase::set_auto_recovery(bool enabled) {
+  defect_monitor.set_auto_recovery(enabled);
+}
+
+void SignalHeadBase::set_cycle_repetitions_limit(
+    unsigned long repetitions_limit) {
+  this->repetitions_limit = repetitions_limit;
+}
+
+void SignalHeadBase::set_auto_lights_off(bool enabled) {
+  if (enabled) {
+    flags |= (1 << FLAG_AUTO_LIGHTS_OFF);
+  } else {
+    flags &= ~(1 << FLAG_AUTO_LIGHTS_OFF);
+  }
+}
+
+void SignalHeadBase::set_event_queue(EventQueueBase *queue) {
+  event_manager.set_queue(queue);
+}
+
+void SignalHeadBase::set_phase_table(const void *table, int phase_count,
+                                     SignalHeadBase::PhaseReader reader) {
+  bool valid = (table != nullptr && phase_count > 0);
+  phase_table = valid ? table : nullptr;
+  read_phase = valid ? reader : nullptr;
+  this->phase_count = valid ? phase_count : 0;
+
+  if (!valid) {
+    disable_cycle(); // Disable the cycle if invalid input
+  } else if (is_cycle_enabled()) {
+    enable_cycle();
+  }
+}
+
+// controls
+void SignalHeadBase::enable_cycle() {
+  if (phase_count == 0)
+    return;
+
+  flags |= (1 << FLAG_ENABLED);
+  phase_index = 0;
+  repetitions_count = 0;
+  phase_start_ms = hal::millis();
+  load_phase();
+}
+
+void SignalHeadBase::disable_cycle() {
+  flags &= ~(1 << FLAG_ENABLED);
+  if (flags & (1 << FLAG_AUTO_LIGHTS_OFF)) {
+    pattern = 0;
+  }
+}
+
+// events
+void SignalHeadBase::register_event(EventName name, void (*callback)()) {
+  event_manager.connect(name, callback);
+}
+
+void SignalHeadBase::unregister_event(EventName name) {
+  event_manager.disconnect(name);
+}
+
+void SignalHeadBase::subscribe_event(EventListener &listener) {
+  event_manager.subscribe(listener);
+}
+
+void SignalHeadBase::unsubscribe_event(EventListener &listener) {
+  event_manager.unsubscribe(listener);
+}
+
+void SignalHeadBase::emit(EventName name, int lamp) {
+  instrumentation::count_event(name);
+  if (!event_manager.is_subscribed(name))
+    return;
+
+  EventPayload payload = {name,          this, -1, lamp, get_phase_index(),
+                          hal::millis()};
+  event_manager.emit(payload);
+}
+
+// update
+void SignalHeadBase::update() {
+  // Run through due phases, each ends where the next one starts
+  unsigned long now = hal::millis();
+  for (int step = 0; step < MAX_CATCH_UP_STEPS && is_behind(now); step++) {
+    phase_start_ms += phase_duration_ms;
+    advance_phase();
+  }
+  if (is_behind(now)) {
+    phase_start_ms = now; // Too far behind, continue from now
+  }
+
+  // power lamps, only written if the pattern changed
+  write_pattern();
+
+  // Test for defects if any test pin is configured
+  if (defect_monitor.has_pins()) {
+    int lamp = defect_monitor.update(pattern);
+    if (lamp >= 0) {
+      emit(defect_monitor.is_intact(lamp) ? EventName::LAMP_RECOVERED
+                                          : EventName::LAMP_DEFECT,
+           lamp);
+    }
+  }
+}
+
+bool SignalHeadBase::is_behind(unsigned long now) {
+  return is_cycle_enabled() && now - phase_start_ms >= phase_duration_ms;
+}
+
+void SignalHeadBase::load_phase() {
+  unsigned long duration_ms;
+  set_pattern(read_phase(phase_table, phase_index, duration_ms));
+  phase_duration_ms = duration_ms;
+}
+
+void SignalHeadBase::advance_phase() {
+  phase_index++;
+
+  if (phase_index >= phase_count) {
+    phase_index = 0;
+    repetitions_count++;
+
+    // Check repetitions limit
+    if (repetitions_limit > 0 && repetitions_count >= repetitions_limit) {
+      disable_cycle();
+      emit(EventName::CYCLE_FINISHED);
+      emit(EventName::CYCLE_REACHED_REPETITIONS_LIMIT);
+      return;
+    }
+    load_phase();
+    emit(EventName::CYCLE_PHASE_CHANGED);
+    emit(EventName::CYCLE_FINISHED);
+    return;
+  }
+
+  load_phase();
+  emit(EventName::CYCLE_PHASE_CHANGED);
+}
+
+void SignalHeadBase::write_pattern() {
+  uint32_t changed = pattern ^ written_pattern;
+
+  // Only visit the lamps that changed
+  for (int i = 0; changed != 0; i++, changed >>= 1) {
+    if (changed & 1) {
+      hal::digital_write(pins[i], (pattern >> i) & 1);
+    }
+  }
+  written_pattern = pattern;
+}
\ No newline at end of file
@@ -0,0 +1,306 @@
+#ifndef SIGNAL_HEAD_H
+#define SIGNAL_HEAD_H
+
+#include "defect_monitor.h"
+#include "events.h"
+#include <stdint.h>
+
+/**
+ * Smallest unsigned type with a bit for each of N lamps.
+ */
+template <int N, bool FITS_8 = (N <= 8), bool FITS_16 = (N <= 16)>
+struct LampMask {
+  typedef uint32_t type;
+};
+
+template <int N, bool FITS_16> struct LampMask<N, true, FITS_16> {
+  typedef uint8_t type;
+};
+
+template <int N> struct LampMask<N, false, true> {
+  typedef uint16_t type;
+};
+
+/**
+ * Phase of a signal head with N lamps.
+ */
+template <int N> struct SignalPhase {
+  typename LampMask<N>::type lamps; // Bit i set if lamp i is on
+  unsigned long duration_ms;
+};
+
+/**
+ * Checks if a signal phase can be shown: it has a duration within the
+ * supported range and no lamp beyond the head is on.
+ * Usable at compile time, e.g. static_assert(is_phase_valid(PHASE), "").
+ * @param phase The phase to check.
+ * @return True if the phase is valid, false otherwise.
+ */
+template <int N> constexpr bool is_phase_valid(const SignalPhase<N> &phase) {
+  return phase.duration_ms > 0 && phase.duration_ms <= 0x7FFFFFFFUL &&
+         (N >= 32 || (static_cast<uint32_t>(phase.lamps) >> N) == 0);
+}
+
+/**
+ * Signal head with any number of lamps, e.g. a pedestrian head, a turn arrow
+ * or a five-lamp head, driven by a cycle of bitmask phases.
+ * The cycle is drift-free: each phase ends at the start of the cycle plus
+ * the durations of all phases so far. Only lamps that change are written.
+ * Defects are reported per lamp with the LAMP_DEFECT and LAMP_RECOVERED
+ * events, the lamp is passed in the payload.
+ *
+ * Use the SignalHead template to get a head with its storage
+ */
+class SignalHeadBase {
+public:
+  /**
+   * Gets the number of lamps.
+   * @return The number of lamps.
+   */
+  int get_lamp_count();
+
+  /**
+   * Gets the lamps that are on.
+   * @return Bit i set if lamp i is on.
+   */
+  uint32_t get_pattern();
+
+  /**
+   * Checks if the cycle is enabled.
+   * @return True if the cycle is enabled, false otherwise.
+   */
+  bool is_cycle_enabled();
+
+  /**
+   * Gets the index of the current phase.
+   * @return The index, -1 if the cycle is disabled.
+   */
+  int get_phase_index();
+
+  /**
+   * Gets the point in time the head next needs an update().
+   * @param deadline_ms Set to the deadline in milliseconds.
+   * @return True if there is a deadline, false if nothing is scheduled.
+   */
+  bool get_next_deadline(unsigned long &deadline_ms);
+
+  /**
+   * Checks if a lamp is intact according to its test pin.
+   * @param lamp The index of the lamp.
+   * @return True if the lamp is intact or untested, false if it is defect.
+   */
+  bool is_lamp_intact(int lamp);
+
+  /**
+   * Sets which lamps are on, written on the next update().
+   * @param lamps Bit i set if lamp i is on.
+   */
+  void set_pattern(uint32_t lamps);
+
+  /**
+   * Switches a single lamp, written on the next update().
+   * @param lamp The index of the lamp.
+   * @param on True to switch the lamp on, false to switch it off.
+   */
+  void set_lamp(int lamp, bool on);
+
+  /**
+   * Sets the analog pin testing a lamp for defects.
+   * @param lamp The index of the lamp.
+   * @param pin The test pin, -1 to disable.
+   */
+  void set_test_pin(int lamp, int pin);
+
+  /**
+   * Sets the reading above which a lamp counts as defect.
+   * @param threshold The analog reading.
+   */
+  void set_defect_threshold(int threshold);
+
+  /**
+   * Sets if defect lamps become intact again when their readings recover.
+   * @param enabled True to enable auto recovery, false to disable.
+   */
+  void set_auto_recovery(bool enabled);
+
+  /**
+   * Sets how often the cycle is repeated before it is disabled.
+   * @param repetitions_limit The number of repetitions, 0 for no limit.
+   */
+  void set_cycle_repetitions_limit(unsigned long repetitions_limit);
+
+  /**
+   * Sets if all lamps are switched off when the cycle is disabled or
+   * reaches its repetitions limit.
+   * @param enabled True to enable auto lights off, false to disable.
+   */
+  void set_auto_lights_off(bool enabled);
+
+  /**
+   * Sets a queue deferring the events of this head.
+   * @param queue The queue, nullptr to deliver events during update().
+   */
+  void set_event_queue(EventQueueBase *queue);
+
+  /**
+   * Enables the cycle, starting with the first phase.
+   */
+  void enable_cycle();
+
+  /**
+   * Disables the cycle.
+   */
+  void disable_cycle();
+
+  /**
+   * Registers an event callback for a specific event.
+   * @param name The name of the event.
+   * @param callback The function to be called when the event is emitted.
+   */
+  void register_event(EventName name, void (*callback)());
+
+  /**
+   * Unregisters an event callback for a specific event.
+   * @param name The name of the event.
+   */
+  void unregister_event(EventName name);
+
+  /**
+   * Subscribes a listener to its event.
+   * @param listener The listener, must stay valid while subscribed.
+   */
+  void subscribe_event(EventListener &listener);
+
+  /**
+   * Unsubscribes a listener from its event.
+   * @param listener The listener.
+   */
+  void unsubscribe_event(EventListener &listener);
+
+  /**
+   * Advances the cycle, writes changed lamps and tests for defects.
+   */
+  void update();
+
+protected:
+  /**
+   * Reads the lamps and duration of a phase from a table of any mask type.
+   */
+  typedef uint32_t (*PhaseReader)(const void *table, int index,
+                                  unsigned long &duration_ms);
+
+  SignalHeadBase(const int *pins, uint8_t lamp_count,
+                 DefectMonitorBase &defect_monitor);
+
+  /**
+   * Configures the lamp pins as outputs and switches the lamps off, called
+   * once the pins are stored.
+   */
+  void begin();
+
+  /**
+   * Makes a table the phases are read from and restarts the cycle.
+   * @param table The phases, must stay valid while they are used.
+   * @param phase_count The number of phases.
+   * @param reader The function reading a phase of the table.
+   */
+  void set_phase_table(const void *table, int phase_count,
+                       PhaseReader reader);
+
+private:
+  // Bit positions for flags
+  static constexpr uint8_t FLAG_ENABLED = 0;
+  static constexpr uint8_t FLAG_AUTO_LIGHTS_OFF = 1;
+  static constexpr int MAX_CATCH_UP_STEPS = 32; // Replayed phases per update
+
+  const int *pins;
+  uint8_t lamp_count;
+  uint8_t flags; // Bitfield for boolean flags
+  uint32_t pattern;
+  uint32_t written_pattern;
+  const void *phase_table;
+  PhaseReader read_phase;
+  int phase_count;
+  int phase_index;
+  unsigned long phase_start_ms;
+  unsigned long phase_duration_ms;
+  unsigned long repetitions_limit;
+  unsigned long repetitions_count;
+  EventManager event_manager;
+  DefectMonitorBase &defect_monitor;
+
+  // Disable copy constructor and assignment
+  SignalHeadBase(const SignalHeadBase &) = delete;
+  SignalHeadBase &operator=(const SignalHeadBase &) = delete;
+
+  /**
+   * Checks if the current phase has ended.
+   * @param now The current time in milliseconds.
+   * @return True if the cycle has to advance, false otherwise.
+   */
+  bool is_behind(unsigned long now);
+
+  /**
+   * Shows the phase at phase_index.
+   */
+  void load_phase();
+
+  /**
+   * Moves to the next phase and emits the cycle events.
+   */
+  void advance_phase();
+
+  /**
+   * Writes the lamps that changed since the last write.
+   */
+  void write_pattern();
+
+  /**
+   * Emits an event of this head.
+   * @param name The name of the event.
+   * @param lamp The lamp the event is about, -1 if none.
+   */
+  void emit(EventName name, int lamp = -1);
+};
+
+/**
+ * Signal head with N lamps
+ */
+template <int N> class SignalHead : public SignalHeadBase {
+  static_assert(N > 0 && N <= 32, "A signal head has 1 to 32 lamps");
+
+private:
+  int pins[N];
+  DefectMonitor<N> monitor;
+
+  static uint32_t read(const void *table, int index,
+                       unsigned long &duration_ms) {
+    const SignalPhase<N> &phase =
+        static_cast<const SignalPhase<N> *>(table)[index];
+    duration_ms = phase.duration_ms;
+    return phase.lamps;
+  }
+
+public:
+  /**
+   * Constructor for the SignalHead class.
+   * @param lamp_pins The pins of the lamps, one per lamp.
+   */
+  template <typename... Pins>
+  explicit SignalHead(Pins... lamp_pins)
+      : SignalHeadBase(pins, N, monitor), pins{lamp_pins...} {
+    static_assert(sizeof...(Pins) == N, "Pass one pin per lamp");
+    begin();
+  }
+
+  /**
+   * Uses phases for the cycle without copying them.
+   * @param phases An array of phases, must stay valid while it is used.
+   * @param phase_count The number of phases in the sequence.
+   */
+  void bind_cycle_phases(const SignalPhase<N> *phases, int phase_count) {
+    set_phase_table(phases, phase_count, &read);
+  }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,124 @@
+#ifndef ARDUINO
+
+#include "simulator.h"
+
+#include <algorithm>
+
+SimulatorBase::SimulatorBase(HostBackend &clock, SimulatedLight *lights,
+                             int *due, int capacity)
+    : clock(clock), scheduler(), lights(lights), due(due), due_count(0),
+      capacity(capacity), count(0), event_count(0), sink(nullptr),
+      sink_context(nullptr) {}
+
+int SimulatorBase::add(TrafficLight &light) {
+  if (count >= capacity) {
+    return -1; // Simulator is full
+  }
+
+  SimulatedLight &entry = lights[count];
+  entry.simulator = this;
+  entry.light = &light;
+
+  // Record every event of the light
+  entry.listener = EventListener(EventName::COUNT, on_event, &entry);
+  light.subscribe_all_events(entry.listener);
+
+  entry.node.callback = on_timer;
+  entry.node.context = &entry;
+  reschedule(entry);
+  return count++;
+}
+
+void SimulatorBase::clear() {
+  for (int i = 0; i < count; i++) {
+    SimulatedLight &entry = lights[i];
+    scheduler.cancel(entry.node);
+    entry.light->unsubscribe_event(entry.listener);
+  }
+  count = 0;
+}
+
+int SimulatorBase::get_count() { return count; }
+
+int SimulatorBase::get_capacity() { return capacity; }
+
+unsigned long SimulatorBase::get_event_count() { return event_count; }
+
+void SimulatorBase::set_event_sink(
+    void (*sink)(void *context, const SimulationEvent &event), void *context) {
+  this->sink = sink;
+  sink_context = context;
+}
+
+unsigned long SimulatorBase::run_until(unsigned long end_ms) {
+  unsigned long steps = 0;
+  unsigned long tick_ms;
+
+  for (int i = 0; i < count; i++) {
+    reschedule(lights[i]);
+  }
+
+  while (scheduler.get_next_deadline(tick_ms) &&
+         hal::time_reached(end_ms, tick_ms)) {
+    // Never move the clock backwards, overdue lights run at the current time
+    if (!hal::time_reached(clock.millis(), tick_ms)) {
+      clock.set_time_ms(tick_ms);
+    }
+
+    due_count = 0;
+    scheduler.advance(clock.millis());
+    if (due_count == 0) {
+      continue; // Only moved timers within the scheduler
+    }
+
+    // Update in the order the lights were added
+    std::sort(due, due + due_count);
+    for (int i = 0; i < due_count; i++) {
+      SimulatedLight &entry = lights[due[i]];
+      entry.light->update();
+      reschedule(entry);
+    }
+    steps++;
+  }
+
+  if (!hal::time_reached(clock.millis(), end_ms)) {
+    clock.set_time_ms(end_ms);
+  }
+  return steps;
+}
+
+unsigned long SimulatorBase::run_for(unsigned long duration_ms) {
+  return run_until(clock.millis() + duration_ms);
+}
+
+void SimulatorBase::reschedule(SimulatedLight &entry) {
+  unsigned long deadline_ms;
+  if (entry.light->get_next_deadline(deadline_ms)) {
+    scheduler.schedule(entry.node, deadline_ms);
+  } else {
+    scheduler.cancel(entry.node);
+  }
+}
+
+void SimulatorBase::on_timer(void *context) {
+  SimulatedLight *entry = static_cast<SimulatedLight *>(context);
+  SimulatorBase *simulator = entry->simulator;
+  simulator->due[simulator->due_count++] =
+      static_cast<int>(entry - simulator->lights);
+}
+
+void SimulatorBase::on_event(void *context, const EventPayload &payload) {
+  SimulatedLight *entry = static_cast<SimulatedLight *>(context);
+  SimulatorBase *simulator = entry->simulator;
+
+  simulator->event_count++;
+  if (simulator->sink == nullptr)
+    return;
+
+  SimulationEvent event = {payload.timestamp_ms,
+                           static_cast<int>(entry - simulator->lights),
+                           payload.name, payload.phase_index};
+  simulator->sink(simulator->sink_context, event);
+}
+
+#endif
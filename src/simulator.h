@@ -0,0 +1,163 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#ifndef ARDUINO
+
+#include "events.h"
+#include "host_backend.h"
+#include "timer_wheel.h"
+#include "traffic_light.h"
+
+class SimulatorBase;
+
+/**
+ * An event recorded by a Simulator.
+ */
+struct SimulationEvent {
+  unsigned long timestamp_ms;
+  int light;       // Index of the light in the simulator
+  EventName name;
+  int phase_index; // Phase of the cycle, -1 if none
+};
+
+/**
+ * A light added to a Simulator with the listener recording its events.
+ */
+struct SimulatedLight {
+  SimulatorBase *simulator;
+  TrafficLight *light;
+  TimerNode node; // Deadline of the light
+  EventListener listener; // Subscribed to every event of the light
+};
+
+/**
+ * Runs traffic lights on the virtual clock of a HostBackend.
+ * Instead of stepping the clock millisecond by millisecond, the simulator
+ * jumps from one deadline of its lights to the next, so only the updates
+ * that change something are run. Lights due at the same time are updated in
+ * the order they were added. Every event is passed to the event sink with
+ * the virtual time it happened at, which gives the same stream as a loop
+ * updating all lights every millisecond.
+ *
+ * The clock has to be the active backend, see hal::set_backend().
+ * Use the Simulator template to get a simulator with its storage.
+ */
+class SimulatorBase {
+public:
+  /**
+   * Adds a light to the simulator.
+   * The light must stay valid while it is in the simulator and must not be
+   * attached to another scheduler.
+   * @param light The traffic light.
+   * @return The index of the light, -1 if the simulator is full.
+   */
+  int add(TrafficLight &light);
+
+  /**
+   * Removes all lights from the simulator.
+   */
+  void clear();
+
+  /**
+   * Gets the number of lights in the simulator.
+   * @return The number of lights.
+   */
+  int get_count();
+
+  /**
+   * Gets the maximum number of lights in the simulator.
+   * @return The capacity of the simulator.
+   */
+  int get_capacity();
+
+  /**
+   * Gets the number of events recorded since the simulator was created.
+   * @return The number of events.
+   */
+  unsigned long get_event_count();
+
+  /**
+   * Sets the function receiving the recorded events.
+   * @param sink The function, nullptr to only count the events.
+   * @param context Passed to the function.
+   */
+  void set_event_sink(void (*sink)(void *context,
+                                   const SimulationEvent &event),
+                      void *context = nullptr);
+
+  /**
+   * Runs the lights until a point in time.
+   * Changes made to the lights since the last run are picked up.
+   * @param end_ms The virtual time to stop at in milliseconds.
+   * @return The number of deadlines run.
+   */
+  unsigned long run_until(unsigned long end_ms);
+
+  /**
+   * Runs the lights for a duration from the current virtual time.
+   * @param duration_ms The duration in milliseconds.
+   * @return The number of deadlines run.
+   */
+  unsigned long run_for(unsigned long duration_ms);
+
+protected:
+  SimulatorBase(HostBackend &clock, SimulatedLight *lights, int *due,
+                int capacity);
+  ~SimulatorBase() = default;
+
+private:
+  HostBackend &clock;
+  TimerWheel scheduler;
+  SimulatedLight *lights;
+  int *due; // Indices of the lights due in the current step
+  int due_count;
+  int capacity;
+  int count;
+  unsigned long event_count;
+  void (*sink)(void *context, const SimulationEvent &event);
+  void *sink_context;
+
+  // Disable copy constructor and assignment
+  SimulatorBase(const SimulatorBase &) = delete;
+  SimulatorBase &operator=(const SimulatorBase &) = delete;
+
+  /**
+   * Schedules the next deadline of a light.
+   * @param entry The light.
+   */
+  void reschedule(SimulatedLight &entry);
+
+  /**
+   * Marks a light as due when its timer expires.
+   * @param context The SimulatedLight.
+   */
+  static void on_timer(void *context);
+
+  /**
+   * Records an event of a light.
+   * @param context The SimulatedLight.
+   * @param payload The data of the event.
+   */
+  static void on_event(void *context, const EventPayload &payload);
+};
+
+/**
+ * Simulator with storage for a fixed number of lights.
+ */
+template <int CAPACITY> class Simulator : public SimulatorBase {
+  static_assert(CAPACITY > 0, "Capacity must be positive");
+
+private:
+  SimulatedLight lights[CAPACITY];
+  int due[CAPACITY];
+
+public:
+  explicit Simulator(HostBackend &clock)
+      : SimulatorBase(clock, lights, due, CAPACITY) {}
+
+  ~Simulator() { clear(); }
+};
+
+#endif
+
+#endif
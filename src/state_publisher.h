@@ -0,0 +1,55 @@
+#ifndef STATE_PUBLISHER_H
+#define STATE_PUBLISHER_H
+
+#include <stdint.h>
+
+class TrafficLight;
+
+/**
+ * Live state of a traffic light as seen by monitoring, e.g. a dashboard.
+ * The layout is fixed, so other processes can read it from shared memory.
+ */
+struct SharedLightState {
+  // Bit positions for flags
+  static constexpr uint8_t FLAG_CYCLE_ENABLED = 0;
+  static constexpr uint8_t FLAG_ACTIVITY_CYCLE_ENABLED = 1;
+  static constexpr uint8_t FLAG_INACTIVE = 2;
+  static constexpr uint8_t FLAG_FAIL_SAFE = 3;
+
+  uint16_t plan_id;           // Identifies the phases of the cycle
+  uint16_t phase_index;       // Index of the current phase
+  uint8_t flags;              // Bitfield for boolean flags
+  uint8_t pattern;            // Bit i set if light i is on
+  uint8_t intact_lights;      // Bit i set if light i is intact
+  uint8_t reserved;           // Always 0
+  uint32_t phase_start_ms;    // Start of the current phase, millis() clock
+  uint32_t repetitions_count; // Completed repetitions of the cycle
+};
+
+static_assert(sizeof(SharedLightState) == 16,
+              "Shared light state must have a fixed layout");
+
+/**
+ * Receives the state of traffic lights, e.g. to share it with other
+ * processes. Every light added to a publisher hands its state over at the
+ * end of each update(); publishers only pass on states that changed.
+ */
+class StatePublisher {
+public:
+  virtual ~StatePublisher() = default;
+
+  /**
+   * Publishes the state of a traffic light, called by the light.
+   * @param slot The slot of the light in the publisher.
+   * @param state The current state.
+   */
+  virtual void publish(int slot, const SharedLightState &state) = 0;
+
+  /**
+   * Removes a traffic light, called by lights that are destroyed.
+   * @param light The traffic light.
+   */
+  virtual void remove(TrafficLight &light) = 0;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include "state_snapshot.h"
+
+namespace {
+
+constexpr uint8_t SNAPSHOT_VERSION = 2;
+constexpr size_t CHECKSUM_OFFSET = STATE_SNAPSHOT_SIZE - 2;
+
+uint8_t *write_u16(uint8_t *out, uint16_t value) {
+  out[0] = value & 0xFF;
+  out[1] = (value >> 8) & 0xFF;
+  return out + 2;
+}
+
+uint8_t *write_u32(uint8_t *out, uint32_t value) {
+  out = write_u16(out, value & 0xFFFF);
+  return write_u16(out, value >> 16);
+}
+
+const uint8_t *read_u16(const uint8_t *in, uint16_t &value) {
+  value = in[0] | (static_cast<uint16_t>(in[1]) << 8);
+  return in + 2;
+}
+
+const uint8_t *read_u32(const uint8_t *in, uint32_t &value) {
+  uint16_t low, high;
+  in = read_u16(in, low);
+  in = read_u16(in, high);
+  value = low | (static_cast<uint32_t>(high) << 16);
+  return in;
+}
+
+uint16_t get_checksum(const uint8_t *data, size_t size) {
+  // Fletcher-16, catches torn writes and reordered bytes
+  uint16_t sum1 = 0, sum2 = 0;
+  for (size_t i = 0; i < size; i++) {
+    sum1 = (sum1 + data[i]) % 255;
+    sum2 = (sum2 + sum1) % 255;
+  }
+  return (sum2 << 8) | sum1;
+}
+
+} // namespace
+
+size_t write_state_snapshot(const StateSnapshot &snapshot, uint8_t *buffer,
+                            size_t size) {
+  if (size < STATE_SNAPSHOT_SIZE)
+    return 0;
+
+  uint8_t *out = buffer;
+  *out++ = 'T';
+  *out++ = 'L';
+  *out++ = 'S';
+  *out++ = SNAPSHOT_VERSION;
+  out = write_u16(out, snapshot.plan_id);
+  out = write_u32(out, snapshot.phase_count);
+  out = write_u32(out, snapshot.phase_index);
+  *out++ = snapshot.flags;
+  *out++ = (snapshot.pattern & 0x07) | ((snapshot.defect_mask & 0x07) << 3);
+  out = write_u32(out, snapshot.phase_elapsed_ms);
+  out = write_u32(out, snapshot.repetitions_count);
+  out = write_u32(out, snapshot.activity_elapsed_ms);
+  out = write_u16(out, get_checksum(buffer, CHECKSUM_OFFSET));
+
+  return out - buffer;
+}
+
+bool read_state_snapshot(const uint8_t *buffer, size_t size,
+                         StateSnapshot &snapshot) {
+  if (size < STATE_SNAPSHOT_SIZE)
+    return false;
+  if (buffer[0] != 'T' || buffer[1] != 'L' || buffer[2] != 'S' ||
+      buffer[3] != SNAPSHOT_VERSION)
+    return false;
+
+  uint16_t checksum;
+  read_u16(buffer + CHECKSUM_OFFSET, checksum);
+  if (checksum != get_checksum(buffer, CHECKSUM_OFFSET))
+    return false;
+
+  const uint8_t *in = buffer + 4;
+  in = read_u16(in, snapshot.plan_id);
+  in = read_u32(in, snapshot.phase_count);
+  in = read_u32(in, snapshot.phase_index);
+  snapshot.flags = *in++;
+  snapshot.pattern = *in & 0x07;
+  snapshot.defect_mask = (*in++ >> 3) & 0x07;
+  in = read_u32(in, snapshot.phase_elapsed_ms);
+  in = read_u32(in, snapshot.repetitions_count);
+  read_u32(in, snapshot.activity_elapsed_ms);
+  return true;
+}
\ No newline at end of file
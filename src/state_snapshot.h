@@ -0,0 +1,56 @@
+#ifndef STATE_SNAPSHOT_H
+#define STATE_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Runtime state of a traffic light, saved to restore it after a reset.
+ * Get it with TrafficLight::save_state() and give it back to
+ * TrafficLight::restore_state() on boot, the configuration (phases, pins,
+ * times) has to be set up before as usual.
+ */
+struct StateSnapshot {
+  // Bit positions for flags
+  static constexpr uint8_t FLAG_CYCLE_ENABLED = 0;
+  static constexpr uint8_t FLAG_ACTIVITY_CYCLE_ENABLED = 1;
+  static constexpr uint8_t FLAG_INACTIVE = 2;
+
+  uint16_t plan_id;             // Identifies the phases the state belongs to
+  uint32_t phase_count;         // Number of phases of the cycle
+  uint32_t phase_index;         // Index of the current phase
+  uint8_t flags;                // Bitfield for boolean flags
+  uint8_t pattern;              // Bit i set if light i is on
+  uint8_t defect_mask;          // Bit i set if light i is defect
+  uint32_t phase_elapsed_ms;    // Time since the current phase started
+  uint32_t repetitions_count;   // Completed repetitions of the cycle
+  uint32_t activity_elapsed_ms; // Time since the activity state started
+};
+
+// Size of an encoded snapshot in bytes
+constexpr size_t STATE_SNAPSHOT_SIZE = 30;
+
+/**
+ * Encodes a snapshot for storage, e.g. in EEPROM, FRAM or a file.
+ * The encoding starts with "TLS" and a version byte, followed by the fields
+ * in little endian and a Fletcher-16 checksum.
+ * @param snapshot The snapshot to encode.
+ * @param buffer The buffer to write to.
+ * @param size The size of the buffer in bytes.
+ * @return The number of bytes written, 0 if the buffer is too small.
+ */
+size_t write_state_snapshot(const StateSnapshot &snapshot, uint8_t *buffer,
+                            size_t size);
+
+/**
+ * Decodes a snapshot written by write_state_snapshot().
+ * @param buffer The buffer to read from.
+ * @param size The size of the buffer in bytes.
+ * @param snapshot Set to the decoded snapshot.
+ * @return True if the buffer holds a valid snapshot, false if it is too
+ * small, has another version or the checksum does not match.
+ */
+bool read_state_snapshot(const uint8_t *buffer, size_t size,
+                         StateSnapshot &snapshot);
+
+#endif
\ No newline at end of file
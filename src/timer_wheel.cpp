@@ -0,0 +1,215 @@
+#include "timer_wheel.h"
+#include "hal.h"
+
+TimerWheel::TimerWheel() : current_ms(0), count(0) {
+  for (uint8_t level = 0; level < LEVELS; level++) {
+    for (uint8_t slot = 0; slot < SLOTS; slot++) {
+      slots[level][slot] = nullptr;
+    }
+    occupied[level] = 0;
+  }
+}
+
+int TimerWheel::get_count() { return count; }
+
+void TimerWheel::schedule(TimerNode &node, unsigned long deadline_ms) {
+  if (is_scheduled(node)) {
+    unlink(node);
+  } else {
+    // An empty wheel has no tick to keep, restart it at the current time
+    if (count == 0) {
+      current_ms = hal::millis();
+    }
+    count++;
+  }
+
+  node.deadline_ms = deadline_ms;
+  insert(node);
+}
+
+void TimerWheel::cancel(TimerNode &node) {
+  if (!is_scheduled(node))
+    return;
+  unlink(node);
+  count--;
+}
+
+bool TimerWheel::is_scheduled(TimerNode &node) {
+  return node.pprev != nullptr;
+}
+
+bool TimerWheel::get_next_deadline(unsigned long &deadline_ms) {
+  return find_next_tick(deadline_ms);
+}
+
+void TimerWheel::update() { advance(hal::millis()); }
+
+void TimerWheel::advance(unsigned long now) {
+  while (count > 0 && hal::time_reached(now, current_ms)) {
+    uint8_t index = current_ms & SLOT_MASK;
+
+    // Entering a new block of the next level
+    if (index == 0) {
+      cascade(1);
+    }
+
+    // Detach the expired nodes, callbacks may schedule or cancel any node
+    TimerNode *expired = slots[0][index];
+    slots[0][index] = nullptr;
+    occupied[0] &= ~(1UL << index);
+    if (expired != nullptr) {
+      expired->pprev = &expired;
+      for (TimerNode *node = expired; node != nullptr; node = node->next) {
+        node->level = LEVEL_EXPIRED;
+      }
+    }
+    current_ms++;
+
+    while (expired != nullptr) {
+      TimerNode *node = expired;
+      unlink(*node);
+      count--;
+      node->callback(node->context);
+    }
+
+    // Skip ticks without work
+    unsigned long next_ms;
+    if (!find_next_tick(next_ms) || !hal::time_reached(now, next_ms)) {
+      break;
+    }
+    current_ms = next_ms;
+  }
+
+  // Nothing left to do until now
+  if (hal::time_reached(now, current_ms)) {
+    current_ms = now + 1;
+  }
+}
+
+void TimerWheel::idle(unsigned long max_idle_ms) {
+  unsigned long deadline_ms = hal::millis() + max_idle_ms;
+
+  unsigned long next_deadline_ms;
+  if (get_next_deadline(next_deadline_ms)) {
+    deadline_ms = hal::earliest(deadline_ms, next_deadline_ms);
+  }
+
+  hal::idle_until(deadline_ms);
+}
+
+void TimerWheel::insert(TimerNode &node) {
+  unsigned long deadline_ms = node.deadline_ms;
+
+  // Overdue timers expire on the next tick
+  if (hal::time_reached(current_ms, deadline_ms)) {
+    deadline_ms = current_ms;
+  }
+
+  // Pick the finest level covering the delay
+  unsigned long delta = deadline_ms - current_ms;
+  uint8_t level = 0;
+  while (level < LEVELS - 1 && (delta >> (SLOT_BITS * (level + 1))) != 0) {
+    level++;
+  }
+  uint8_t slot = (deadline_ms >> (SLOT_BITS * level)) & SLOT_MASK;
+
+  TimerNode **head = &slots[level][slot];
+  node.next = *head;
+  if (node.next != nullptr) {
+    node.next->pprev = &node.next;
+  }
+  node.pprev = head;
+  *head = &node;
+
+  node.level = level;
+  node.slot = slot;
+  occupied[level] |= (1UL << slot);
+}
+
+void TimerWheel::unlink(TimerNode &node) {
+  *node.pprev = node.next;
+  if (node.next != nullptr) {
+    node.next->pprev = node.pprev;
+  }
+
+  if (node.level < LEVELS && slots[node.level][node.slot] == nullptr) {
+    occupied[node.level] &= ~(1UL << node.slot);
+  }
+
+  node.next = nullptr;
+  node.pprev = nullptr;
+}
+
+void TimerWheel::cascade(uint8_t level) {
+  uint8_t index = (current_ms >> (SLOT_BITS * level)) & SLOT_MASK;
+
+  // Entering a new block of the next level as well
+  if (index == 0 && level + 1 < LEVELS) {
+    cascade(level + 1);
+  }
+
+  TimerNode *node = slots[level][index];
+  slots[level][index] = nullptr;
+  occupied[level] &= ~(1UL << index);
+
+  while (node != nullptr) {
+    TimerNode *next = node->next;
+    insert(*node);
+    node = next;
+  }
+}
+
+uint8_t TimerWheel::find_occupied(uint8_t level, uint8_t slot) {
+  uint32_t mask = occupied[level];
+  if (mask == 0)
+    return SLOTS;
+
+  // Rotate the slot to bit 0
+  if (slot != 0) {
+    mask = (mask >> slot) | (mask << (SLOTS - slot));
+  }
+  return __builtin_ctzl(mask);
+}
+
+bool TimerWheel::find_next_tick(unsigned long &tick_ms) {
+  if (count == 0)
+    return false;
+
+  bool found = false;
+  for (uint8_t level = 0; level < LEVELS; level++) {
+    uint8_t shift = SLOT_BITS * level;
+    uint8_t index = (current_ms >> shift) & SLOT_MASK;
+    unsigned long candidate_ms;
+
+    if (level == 0) {
+      // Slots of the finest level expire exactly at their tick
+      uint8_t distance = find_occupied(0, index);
+      if (distance == SLOTS)
+        continue;
+      candidate_ms = current_ms + distance;
+    } else {
+      unsigned long block = current_ms >> shift;
+      bool at_block_start = (current_ms & ((1UL << shift) - 1)) == 0;
+
+      // Coarser levels have no work before the next block of this level
+      unsigned long earliest_ms =
+          at_block_start ? current_ms : (block + 1) << shift;
+      if (found && hal::time_reached(earliest_ms, tick_ms))
+        break;
+
+      if (at_block_start && (occupied[level] & (1UL << index))) {
+        candidate_ms = current_ms; // Slot not cascaded yet
+      } else {
+        // Slots of coarser levels need work when their block starts
+        uint8_t distance = find_occupied(level, (index + 1) & SLOT_MASK);
+        if (distance == SLOTS)
+          continue;
+        candidate_ms = (block + 1 + distance) << shift;
+      }
+    }
+
+    tick_ms = found ? hal::earliest(tick_ms, candidate_ms) : candidate_ms;
+    found = true;
+  }
+  return found;
+}
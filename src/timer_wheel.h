@@ -0,0 +1,135 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+/**
+ * A timer registered with a TimerWheel.
+ * Nodes are owned by the caller, the wheel only links them, so scheduling
+ * never allocates.
+ */
+struct TimerNode {
+  TimerNode *next;
+  TimerNode **pprev; // Link pointing to this node, nullptr if not scheduled
+  unsigned long deadline_ms;
+  void (*callback)(void *context);
+  void *context;
+  uint8_t level;
+  uint8_t slot;
+
+  TimerNode()
+      : next(nullptr), pprev(nullptr), deadline_ms(0), callback(nullptr),
+        context(nullptr), level(0), slot(0) {}
+};
+
+/**
+ * Hierarchical timer wheel.
+ * Timers are sorted into slots of increasing granularity, so advancing the
+ * wheel only touches the timers that expire instead of every timer.
+ * Delays must be shorter than ~24 days.
+ */
+class TimerWheel {
+private:
+  static constexpr uint8_t SLOT_BITS = 5;
+  static constexpr uint8_t SLOTS = 1 << SLOT_BITS;
+  static constexpr uint8_t SLOT_MASK = SLOTS - 1;
+  static constexpr uint8_t LEVELS = 7;
+  static constexpr uint8_t LEVEL_EXPIRED = LEVELS; // Level of expiring nodes
+
+  TimerNode *slots[LEVELS][SLOTS];
+  uint32_t occupied[LEVELS]; // Bit i set if slot i has nodes
+  unsigned long current_ms;  // Next tick to process
+  int count;
+
+  // Disable copy constructor and assignment
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+
+  /**
+   * Links a node into the slot matching its deadline.
+   */
+  void insert(TimerNode &node);
+
+  /**
+   * Unlinks a node from its list.
+   */
+  void unlink(TimerNode &node);
+
+  /**
+   * Moves the nodes of the current slot of a level to lower levels.
+   */
+  void cascade(uint8_t level);
+
+  /**
+   * Gets the next occupied slot of a level at or after a slot, wrapping
+   * around at the end of the level.
+   * @return The distance to the occupied slot, SLOTS if there is none.
+   */
+  uint8_t find_occupied(uint8_t level, uint8_t slot);
+
+  /**
+   * Gets the next tick with work, i.e. an expiring timer or a slot to
+   * cascade.
+   * @return True if a timer is scheduled, false otherwise.
+   */
+  bool find_next_tick(unsigned long &tick_ms);
+
+public:
+  TimerWheel();
+  ~TimerWheel() = default;
+
+  /**
+   * Gets the number of scheduled timers.
+   * @return The number of timers.
+   */
+  int get_count();
+
+  /**
+   * Schedules a timer, rescheduling it if it is already scheduled.
+   * @param node The timer, must stay valid while scheduled.
+   * @param deadline_ms The point in time in milliseconds the callback of the
+   * node is called.
+   */
+  void schedule(TimerNode &node, unsigned long deadline_ms);
+
+  /**
+   * Cancels a timer, does nothing if the timer is not scheduled.
+   * @param node The timer.
+   */
+  void cancel(TimerNode &node);
+
+  /**
+   * Checks if a timer is scheduled.
+   * @param node The timer.
+   * @return True if the timer is scheduled, false otherwise.
+   */
+  bool is_scheduled(TimerNode &node);
+
+  /**
+   * Gets the point in time the wheel next needs an update.
+   * May be earlier than the next timer when timers move between levels.
+   * @param deadline_ms Set to the deadline in milliseconds.
+   * @return True if a timer is scheduled, false otherwise.
+   */
+  bool get_next_deadline(unsigned long &deadline_ms);
+
+  /**
+   * Calls the callbacks of all timers expired until now.
+   */
+  void update();
+
+  /**
+   * Calls the callbacks of all timers expired until a point in time.
+   * Timers expiring at the same time are called in no particular order.
+   * @param now The point in time in milliseconds.
+   */
+  void advance(unsigned long now);
+
+  /**
+   * Idles until the next deadline. Call update() afterwards.
+   * @param max_idle_ms The maximum time in milliseconds to idle.
+   */
+  void idle(unsigned long max_idle_ms = 1000);
+};
+
+#endif
@@ -0,0 +1,121 @@
+#if !defined(ARDUINO) && defined(__linux__)
+
+#include "timerfd_timer.h"
+
+#include <poll.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace {
+constexpr long NANOSECONDS_PER_MS = 1000000L;
+constexpr long NANOSECONDS_PER_SECOND = 1000000000L;
+} // namespace
+
+TimerfdTimer::TimerfdTimer(HostBackend &backend)
+    : backend(backend), timer_fd(-1), stop_fd(-1), origin(), origin_ms(0) {}
+
+TimerfdTimer::~TimerfdTimer() { end(); }
+
+bool TimerfdTimer::start() {
+  timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  stop_fd = eventfd(0, EFD_CLOEXEC);
+  if (timer_fd < 0 || stop_fd < 0) {
+    stop();
+    return false;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &origin);
+  origin_ms = backend.millis();
+  thread = std::thread(&TimerfdTimer::run, this);
+  return true;
+}
+
+void TimerfdTimer::stop() {
+  if (thread.joinable()) {
+    uint64_t value = 1;
+    ssize_t written = write(stop_fd, &value, sizeof(value));
+    (void)written;
+    thread.join();
+  }
+
+  if (timer_fd >= 0) {
+    close(timer_fd);
+    timer_fd = -1;
+  }
+  if (stop_fd >= 0) {
+    close(stop_fd);
+    stop_fd = -1;
+  }
+}
+
+void TimerfdTimer::arm(unsigned long deadline_ms) {
+  // Deadlines before the origin are in the past and expire at once
+  long offset_ms = static_cast<long>(deadline_ms - origin_ms);
+  if (offset_ms < 0) {
+    offset_ms = 0;
+  }
+
+  struct itimerspec spec = {};
+  spec.it_value.tv_sec = origin.tv_sec + offset_ms / 1000;
+  spec.it_value.tv_nsec =
+      origin.tv_nsec + (offset_ms % 1000) * NANOSECONDS_PER_MS;
+  if (spec.it_value.tv_nsec >= NANOSECONDS_PER_SECOND) {
+    spec.it_value.tv_sec++;
+    spec.it_value.tv_nsec -= NANOSECONDS_PER_SECOND;
+  }
+  timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void TimerfdTimer::disarm() {
+  struct itimerspec spec = {};
+  timerfd_settime(timer_fd, 0, &spec, nullptr);
+}
+
+void TimerfdTimer::lock() {
+  mutex.lock();
+  sync_time();
+}
+
+void TimerfdTimer::unlock() {
+  rearm();
+  mutex.unlock();
+}
+
+void TimerfdTimer::sync_time() {
+  if (timer_fd < 0)
+    return;
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long long elapsed_ms =
+      (static_cast<long long>(now.tv_sec) - origin.tv_sec) * 1000LL +
+      (now.tv_nsec - origin.tv_nsec) / NANOSECONDS_PER_MS;
+  backend.set_time_ms(origin_ms + static_cast<unsigned long>(elapsed_ms));
+}
+
+void TimerfdTimer::run() {
+  // The backend is set per thread
+  hal::set_backend(&backend);
+
+  struct pollfd fds[2] = {{timer_fd, POLLIN, 0}, {stop_fd, POLLIN, 0}};
+  while (true) {
+    if (poll(fds, 2, -1) < 0)
+      continue; // Interrupted by a signal
+    if (fds[1].revents != 0)
+      break;
+    if (fds[0].revents == 0)
+      continue;
+
+    uint64_t expirations;
+    if (read(timer_fd, &expirations, sizeof(expirations)) < 0)
+      continue; // Rearmed since poll() returned
+
+    std::lock_guard<std::mutex> guard(mutex);
+    sync_time();
+    handle_expiry();
+  }
+}
+
+#endif
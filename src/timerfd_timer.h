@@ -0,0 +1,66 @@
+#ifndef TIMERFD_TIMER_H
+#define TIMERFD_TIMER_H
+
+#if !defined(ARDUINO) && defined(__linux__)
+
+#include "host_backend.h"
+#include "interrupt_timer.h"
+
+#include <mutex>
+#include <thread>
+#include <time.h>
+
+/**
+ * Drives a TimerWheel from a Linux timerfd, for running timer driven
+ * traffic lights on a host. A thread waits for the timer and updates the
+ * wheel, the virtual clock of the host backend follows the monotonic clock
+ * from begin() on. Use the backend in the thread calling begin() as well
+ * and read its time only while locked.
+ * Programs using TimerfdTimer have to be linked with -pthread.
+ */
+class TimerfdTimer : public InterruptTimer {
+private:
+  HostBackend &backend;
+  std::mutex mutex;
+  std::thread thread;
+  int timer_fd;
+  int stop_fd;
+  struct timespec origin; // Monotonic time of origin_ms
+  unsigned long origin_ms;
+
+  /**
+   * Sets the time of the backend to the monotonic clock.
+   */
+  void sync_time();
+
+  /**
+   * Waits for the timer and handles its expiries until stopped.
+   */
+  void run();
+
+protected:
+  bool start() override;
+  void stop() override;
+  void arm(unsigned long deadline_ms) override;
+  void disarm() override;
+
+public:
+  /**
+   * Constructor for the TimerfdTimer class.
+   * @param backend The backend whose clock is driven, must stay valid while
+   * the timer runs.
+   */
+  explicit TimerfdTimer(HostBackend &backend);
+  ~TimerfdTimer() override;
+
+  /**
+   * Locks the mutex the timer thread holds while it updates the wheel and
+   * brings the time of the backend up to date.
+   */
+  void lock() override;
+  void unlock() override;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef TIMING_MODE_H
+#define TIMING_MODE_H
+
+#include <stdint.h>
+
+/**
+ * How cycles schedule the next phase when update() runs late.
+ */
+enum class TimingMode : uint8_t {
+  // Each phase starts when update() notices the end of the previous one, so
+  // late updates delay all following phases
+  RELATIVE,
+  // Each phase ends at the start plus the sum of all durations so far, phases
+  // missed by a late update are skipped
+  ABSOLUTE_SKIP,
+  // Like ABSOLUTE_SKIP, but missed phases are run through one by one, so their
+  // events are emitted
+  ABSOLUTE_REPLAY
+};
+
+#endif
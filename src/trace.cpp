@@ -0,0 +1,366 @@
+#include "trace.h"
+#include "traffic_light.h"
+
+namespace {
+
+constexpr uint8_t TRACE_VERSION = 1;
+constexpr int MAX_FIELDS = 5;
+
+// Number of fields following the kind byte of each record
+constexpr int FIELD_COUNTS[] = {1, 2, 1, 1, 5};
+constexpr int RECORD_KINDS = sizeof(FIELD_COUNTS) / sizeof(FIELD_COUNTS[0]);
+
+uint8_t *write_varint(uint8_t *out, uint32_t value) {
+  while (value >= 0x80) {
+    *out++ = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  *out++ = static_cast<uint8_t>(value);
+  return out;
+}
+
+// Maps small negative numbers to small varints
+uint32_t zigzag(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^
+         static_cast<uint32_t>(value >> 31);
+}
+
+} // namespace
+
+// TraceBackend
+TraceBackend::TraceBackend() {
+  for (int i = 0; i < static_cast<int>(EventName::COUNT); i++) {
+    listeners[i] =
+        EventListener(static_cast<EventName>(i), on_listener_event, this);
+  }
+}
+
+void TraceBackend::attach(TrafficLight &light) {
+  for (int i = 0; i < static_cast<int>(EventName::COUNT); i++) {
+    light.subscribe_event(listeners[i]);
+  }
+}
+
+void TraceBackend::detach(TrafficLight &light) {
+  for (int i = 0; i < static_cast<int>(EventName::COUNT); i++) {
+    light.unsubscribe_event(listeners[i]);
+  }
+}
+
+void TraceBackend::on_listener_event(void *context,
+                                     const EventPayload &payload) {
+  static_cast<TraceBackend *>(context)->on_event(payload);
+}
+
+// TraceRecorder
+TraceRecorder::TraceRecorder(HardwareBackend &inner, Writer writer,
+                             void *context)
+    : inner(&inner), writer(writer), context(context), last_clock_ms(0),
+      record_count(0), byte_count(0) {
+  write_header();
+}
+
+void TraceRecorder::write_header() {
+  const uint8_t header[TRACE_HEADER_SIZE] = {'T', 'L', 'T', TRACE_VERSION};
+  writer(context, header, sizeof(header));
+  byte_count += sizeof(header);
+}
+
+void TraceRecorder::write_record(const uint8_t *record, size_t size) {
+  writer(context, record, size);
+  record_count++;
+  byte_count += size;
+}
+
+unsigned long TraceRecorder::millis() {
+  unsigned long now = inner->millis();
+
+  uint8_t record[MAX_TRACE_RECORD_SIZE];
+  uint8_t *out = record;
+  *out++ = static_cast<uint8_t>(TraceRecord::CLOCK);
+  out = write_varint(out, static_cast<uint32_t>(now - last_clock_ms));
+  write_record(record, out - record);
+
+  last_clock_ms = now;
+  return now;
+}
+
+void TraceRecorder::pin_mode(int pin, PinMode mode) {
+  inner->pin_mode(pin, mode);
+}
+
+void TraceRecorder::digital_write(int pin, bool value) {
+  inner->digital_write(pin, value);
+}
+
+void TraceRecorder::analog_write(int pin, uint8_t value) {
+  inner->analog_write(pin, value);
+}
+
+int TraceRecorder::analog_read(int pin) {
+  int value = inner->analog_read(pin);
+
+  uint8_t record[MAX_TRACE_RECORD_SIZE];
+  uint8_t *out = record;
+  *out++ = static_cast<uint8_t>(TraceRecord::ANALOG);
+  out = write_varint(out, static_cast<uint32_t>(pin));
+  out = write_varint(out, static_cast<uint32_t>(value));
+  write_record(record, out - record);
+
+  return value;
+}
+
+bool TraceRecorder::digital_read(int pin) {
+  bool value = inner->digital_read(pin);
+
+  uint8_t record[MAX_TRACE_RECORD_SIZE];
+  uint8_t *out = record;
+  *out++ = static_cast<uint8_t>(value ? TraceRecord::DIGITAL_HIGH
+                                      : TraceRecord::DIGITAL_LOW);
+  out = write_varint(out, static_cast<uint32_t>(pin));
+  write_record(record, out - record);
+
+  return value;
+}
+
+bool TraceRecorder::bind_port(const int *pins, int count,
+                              PortBinding &binding) {
+  return inner->bind_port(pins, count, binding);
+}
+
+void TraceRecorder::write_port(const PortBinding &binding, uint8_t mask) {
+  inner->write_port(binding, mask);
+}
+
+void TraceRecorder::idle_until(unsigned long deadline_ms) {
+  inner->idle_until(deadline_ms);
+}
+
+void TraceRecorder::on_event(const EventPayload &payload) {
+  uint8_t record[MAX_TRACE_RECORD_SIZE];
+  uint8_t *out = record;
+  *out++ = static_cast<uint8_t>(TraceRecord::EVENT);
+  out = write_varint(out, static_cast<uint32_t>(payload.name));
+  out = write_varint(out, static_cast<uint32_t>(payload.slot + 1));
+  out = write_varint(out, static_cast<uint32_t>(payload.lamp + 1));
+  out = write_varint(out, static_cast<uint32_t>(payload.phase_index + 1));
+  // Events carry a time read just before, relative to it it stays small
+  out = write_varint(out, zigzag(static_cast<int32_t>(payload.timestamp_ms -
+                                                      last_clock_ms)));
+  write_record(record, out - record);
+}
+
+unsigned long TraceRecorder::get_record_count() { return record_count; }
+
+unsigned long TraceRecorder::get_byte_count() { return byte_count; }
+
+#ifndef ARDUINO
+
+#include <stdio.h>
+
+void TraceRecorder::write_to_file(void *context, const uint8_t *data,
+                                  size_t size) {
+  fwrite(data, 1, size, static_cast<FILE *>(context));
+}
+
+namespace {
+
+int32_t unzigzag(uint32_t value) {
+  return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+/**
+ * Decodes the record at an offset of a trace.
+ * @return The offset of the following record, 0 if the record is invalid.
+ */
+size_t read_record(const uint8_t *trace, size_t size, size_t offset,
+                   TraceRecord &kind, uint32_t *fields) {
+  if (offset >= size || trace[offset] >= RECORD_KINDS)
+    return 0;
+
+  kind = static_cast<TraceRecord>(trace[offset++]);
+  for (int i = 0; i < FIELD_COUNTS[static_cast<int>(kind)]; i++) {
+    uint32_t value = 0;
+    uint8_t shift = 0;
+    uint8_t byte;
+    do {
+      if (offset >= size || shift > 28)
+        return 0;
+      byte = trace[offset++];
+      value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    fields[i] = value;
+  }
+  return offset;
+}
+
+} // namespace
+
+// TraceReplayer
+TraceReplayer::TraceReplayer(const uint8_t *trace, size_t size)
+    : trace(trace), size(size),
+      valid(size >= TRACE_HEADER_SIZE && trace[0] == 'T' && trace[1] == 'L' &&
+            trace[2] == 'T' && trace[3] == TRACE_VERSION) {
+  rewind();
+}
+
+void TraceReplayer::rewind() {
+  input_offset = TRACE_HEADER_SIZE;
+  event_offset = TRACE_HEADER_SIZE;
+  input_clock_ms = 0;
+  event_clock_ms = 0;
+  event_count = 0;
+  mismatch_count = 0;
+  first_mismatch = -1;
+  input_mismatch_count = 0;
+}
+
+bool TraceReplayer::peek_input(TraceRecord &kind) {
+  if (!valid)
+    return false;
+
+  uint32_t fields[MAX_FIELDS];
+  while (true) {
+    size_t next = read_record(trace, size, input_offset, kind, fields);
+    if (next == 0)
+      return false;
+    if (kind != TraceRecord::EVENT)
+      return true;
+    input_offset = next;
+  }
+}
+
+bool TraceReplayer::read_input(TraceRecord kind, int pin,
+                               unsigned long &value) {
+  TraceRecord next_kind;
+  if (!peek_input(next_kind))
+    return false;
+
+  // Every read takes a record, so a diverging replay still comes to an end
+  uint32_t fields[MAX_FIELDS];
+  input_offset = read_record(trace, size, input_offset, next_kind, fields);
+  if (next_kind == TraceRecord::CLOCK) {
+    input_clock_ms = static_cast<uint32_t>(input_clock_ms + fields[0]);
+  }
+
+  bool digital = kind == TraceRecord::DIGITAL_LOW ||
+                 kind == TraceRecord::DIGITAL_HIGH;
+  bool next_digital = next_kind == TraceRecord::DIGITAL_LOW ||
+                      next_kind == TraceRecord::DIGITAL_HIGH;
+  if ((digital ? !next_digital : next_kind != kind) ||
+      (kind != TraceRecord::CLOCK && fields[0] != static_cast<uint32_t>(pin))) {
+    input_mismatch_count++;
+    return false;
+  }
+
+  if (kind == TraceRecord::CLOCK) {
+    value = input_clock_ms;
+  } else if (kind == TraceRecord::ANALOG) {
+    value = fields[1];
+  } else {
+    value = next_kind == TraceRecord::DIGITAL_HIGH;
+  }
+  return true;
+}
+
+unsigned long TraceReplayer::millis() {
+  unsigned long value;
+  read_input(TraceRecord::CLOCK, 0, value);
+  return input_clock_ms;
+}
+
+void TraceReplayer::pin_mode(int, PinMode) {}
+
+void TraceReplayer::digital_write(int, bool) {}
+
+void TraceReplayer::analog_write(int, uint8_t) {}
+
+int TraceReplayer::analog_read(int pin) {
+  unsigned long value;
+  return read_input(TraceRecord::ANALOG, pin, value) ? value : 0;
+}
+
+bool TraceReplayer::digital_read(int pin) {
+  unsigned long value;
+  return read_input(TraceRecord::DIGITAL_HIGH, pin, value) && value != 0;
+}
+
+void TraceReplayer::idle_until(unsigned long) {}
+
+void TraceReplayer::count_mismatch() {
+  if (first_mismatch < 0) {
+    first_mismatch = event_count - 1;
+  }
+  mismatch_count++;
+}
+
+void TraceReplayer::on_event(const EventPayload &payload) {
+  event_count++;
+  if (!valid) {
+    count_mismatch();
+    return;
+  }
+
+  // Find the next recorded event, following the clock on the way
+  TraceRecord kind;
+  uint32_t fields[MAX_FIELDS];
+  while (true) {
+    size_t next = read_record(trace, size, event_offset, kind, fields);
+    if (next == 0) {
+      count_mismatch(); // More events than recorded
+      return;
+    }
+    event_offset = next;
+    if (kind == TraceRecord::CLOCK) {
+      event_clock_ms = static_cast<uint32_t>(event_clock_ms + fields[0]);
+    } else if (kind == TraceRecord::EVENT) {
+      break;
+    }
+  }
+
+  unsigned long timestamp_ms =
+      static_cast<uint32_t>(event_clock_ms + unzigzag(fields[4]));
+  if (fields[0] != static_cast<uint32_t>(payload.name) ||
+      fields[1] != static_cast<uint32_t>(payload.slot + 1) ||
+      fields[2] != static_cast<uint32_t>(payload.lamp + 1) ||
+      fields[3] != static_cast<uint32_t>(payload.phase_index + 1) ||
+      timestamp_ms != static_cast<uint32_t>(payload.timestamp_ms)) {
+    count_mismatch();
+  }
+}
+
+bool TraceReplayer::is_valid() { return valid; }
+
+bool TraceReplayer::is_finished() {
+  TraceRecord kind;
+  return !peek_input(kind);
+}
+
+unsigned long TraceReplayer::get_event_count() { return event_count; }
+
+unsigned long TraceReplayer::get_mismatch_count() {
+  // Recorded events that were never emitted
+  unsigned long missing_count = 0;
+  TraceRecord kind;
+  uint32_t fields[MAX_FIELDS];
+  size_t offset = event_offset;
+  while ((offset = read_record(trace, size, offset, kind, fields)) != 0) {
+    if (kind == TraceRecord::EVENT) {
+      missing_count++;
+    }
+  }
+  return mismatch_count + missing_count;
+}
+
+long TraceReplayer::get_first_mismatch() {
+  if (first_mismatch < 0 && get_mismatch_count() > 0)
+    return event_count; // The next event was recorded but not emitted
+  return first_mismatch;
+}
+
+unsigned long TraceReplayer::get_input_mismatch_count() {
+  return input_mismatch_count;
+}
+
+#endif
@@ -0,0 +1,267 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "events.h"
+#include "hal.h"
+#include <stddef.h>
+#include <stdint.h>
+
+class TrafficLight;
+
+/**
+ * Kinds of records in a trace.
+ * A trace starts with "TLT" and a version byte, followed by records of one
+ * kind byte and their fields. Fields are stored as LEB128 varints, so
+ * small values take a single byte. Times are stored modulo 2^32, as on
+ * Arduino boards.
+ */
+enum class TraceRecord : uint8_t {
+  CLOCK,        // millis() read, delta to the previous read
+  ANALOG,       // analog_read(), pin and value
+  DIGITAL_LOW,  // digital_read() returning LOW, pin
+  DIGITAL_HIGH, // digital_read() returning HIGH, pin
+  EVENT         // Emitted event, name, slot, lamp, phase and timestamp
+};
+
+// Size of the trace header in bytes
+constexpr size_t TRACE_HEADER_SIZE = 4;
+
+// Longest encoded record in bytes
+constexpr size_t MAX_TRACE_RECORD_SIZE = 26;
+
+/**
+ * Backend taking part in the events of traffic lights, the common part of
+ * TraceRecorder and TraceReplayer.
+ */
+class TraceBackend : public HardwareBackend {
+private:
+  EventListener listeners[static_cast<int>(EventName::COUNT)];
+
+  /**
+   * Forwards an event of an attached traffic light to on_event().
+   */
+  static void on_listener_event(void *context, const EventPayload &payload);
+
+  // Disable copy constructor and assignment
+  TraceBackend(const TraceBackend &) = delete;
+  TraceBackend &operator=(const TraceBackend &) = delete;
+
+protected:
+  TraceBackend();
+
+  /**
+   * Handles an event of an attached traffic light.
+   * @param payload The event.
+   */
+  virtual void on_event(const EventPayload &payload) = 0;
+
+public:
+  /**
+   * Subscribes to all events of a traffic light. Only one traffic light can
+   * be attached at a time, attaching another one detaches the previous one.
+   * @param light The traffic light, must outlive the backend or be detached.
+   */
+  void attach(TrafficLight &light);
+
+  /**
+   * Unsubscribes from the events of a traffic light.
+   * @param light The attached traffic light.
+   */
+  void detach(TrafficLight &light);
+};
+
+/**
+ * Backend recording the inputs of the library to a trace.
+ * Every clock read, ADC sample and digital read is passed to another
+ * backend and recorded with its result, together with the events of the
+ * attached traffic light, e.g. to capture a field incident and replay it
+ * with TraceReplayer. Set the recorder as backend before the traffic light
+ * is configured, so the replay sees the same inputs from the start.
+ */
+class TraceRecorder : public TraceBackend {
+public:
+  /**
+   * Receives the encoded trace, one record per call.
+   * @param context The context given to the recorder.
+   * @param data The bytes to write.
+   * @param size The number of bytes.
+   */
+  typedef void (*Writer)(void *context, const uint8_t *data, size_t size);
+
+private:
+  HardwareBackend *inner;
+  Writer writer;
+  void *context;
+  unsigned long last_clock_ms;
+  unsigned long record_count;
+  unsigned long byte_count;
+
+  /**
+   * Writes the header of the trace.
+   */
+  void write_header();
+
+  /**
+   * Writes a record and counts it.
+   */
+  void write_record(const uint8_t *record, size_t size);
+
+protected:
+  void on_event(const EventPayload &payload) override;
+
+public:
+  /**
+   * Constructor for the TraceRecorder class, writes the trace header.
+   * @param inner The backend doing the actual work.
+   * @param writer The function receiving the trace.
+   * @param context Passed to the writer, e.g. a file.
+   */
+  TraceRecorder(HardwareBackend &inner, Writer writer, void *context);
+  ~TraceRecorder() override = default;
+
+  unsigned long millis() override;
+  void pin_mode(int pin, PinMode mode) override;
+  void digital_write(int pin, bool value) override;
+  void analog_write(int pin, uint8_t value) override;
+  int analog_read(int pin) override;
+  bool digital_read(int pin) override;
+  bool bind_port(const int *pins, int count, PortBinding &binding) override;
+  void write_port(const PortBinding &binding, uint8_t mask) override;
+  void idle_until(unsigned long deadline_ms) override;
+
+  /**
+   * Gets the number of records written, without the header.
+   * @return The number of records.
+   */
+  unsigned long get_record_count();
+
+  /**
+   * Gets the size of the trace written so far.
+   * @return The size in bytes, including the header.
+   */
+  unsigned long get_byte_count();
+
+#ifndef ARDUINO
+  /**
+   * Writer appending the trace to a file.
+   * @param context The FILE to write to.
+   */
+  static void write_to_file(void *context, const uint8_t *data, size_t size);
+#endif
+};
+
+#ifndef ARDUINO
+
+/**
+ * Backend replaying a recorded trace on the host.
+ * Clock reads, ADC samples and digital reads return the recorded values in
+ * order, outputs are discarded, so the library runs as fast as the CPU
+ * allows. The events of the attached traffic light are compared with the
+ * recorded events; any difference means the library behaves differently
+ * on the same inputs.
+ *
+ * Replay with the same configuration as the recording:
+ *   replayer.attach(light);
+ *   while (!replayer.is_finished()) light.update();
+ */
+class TraceReplayer : public TraceBackend {
+private:
+  const uint8_t *trace;
+  size_t size;
+  size_t input_offset; // Next record to check for inputs
+  size_t event_offset; // Next record to check for events
+  unsigned long input_clock_ms;
+  unsigned long event_clock_ms;
+  unsigned long event_count;
+  unsigned long mismatch_count;
+  long first_mismatch;
+  unsigned long input_mismatch_count;
+  bool valid;
+
+  /**
+   * Finds the next input record, skipping events.
+   * @param kind Set to the kind of the record.
+   * @return True if an input record is left, false otherwise.
+   */
+  bool peek_input(TraceRecord &kind);
+
+  /**
+   * Takes the next input record and reads its value if it has the expected
+   * kind and pin, counts a mismatch otherwise.
+   * @return True if the record matched, false otherwise.
+   */
+  bool read_input(TraceRecord kind, int pin, unsigned long &value);
+
+  /**
+   * Counts an event differing from the trace.
+   */
+  void count_mismatch();
+
+protected:
+  void on_event(const EventPayload &payload) override;
+
+public:
+  /**
+   * Constructor for the TraceReplayer class.
+   * @param trace The recorded trace, must stay valid while replayed.
+   * @param size The size of the trace in bytes.
+   */
+  TraceReplayer(const uint8_t *trace, size_t size);
+  ~TraceReplayer() override = default;
+
+  unsigned long millis() override;
+  void pin_mode(int pin, PinMode mode) override;
+  void digital_write(int pin, bool value) override;
+  void analog_write(int pin, uint8_t value) override;
+  int analog_read(int pin) override;
+  bool digital_read(int pin) override;
+  void idle_until(unsigned long deadline_ms) override;
+
+  /**
+   * Checks if the trace has a valid header.
+   * @return True if the trace can be replayed, false otherwise.
+   */
+  bool is_valid();
+
+  /**
+   * Checks if all recorded inputs were read.
+   * @return True if the replay is finished, false otherwise.
+   */
+  bool is_finished();
+
+  /**
+   * Starts the replay from the beginning, e.g. to run it again as a
+   * benchmark with a freshly configured traffic light.
+   */
+  void rewind();
+
+  /**
+   * Gets the number of events emitted during the replay.
+   * @return The number of events.
+   */
+  unsigned long get_event_count();
+
+  /**
+   * Gets the number of differences between the emitted and the recorded
+   * events, including recorded events that were not emitted (yet).
+   * @return The number of differences, 0 if the replay matches the trace.
+   */
+  unsigned long get_mismatch_count();
+
+  /**
+   * Gets the position of the first difference in the event stream.
+   * @return The index of the event, -1 if there is no difference.
+   */
+  long get_first_mismatch();
+
+  /**
+   * Gets the number of input reads that did not match the next recorded
+   * input, e.g. because the library read the inputs in another order.
+   * @return The number of mismatching reads.
+   */
+  unsigned long get_input_mismatch_count();
+};
+
+#endif
+
+#endif
@@ -1,17 +1,27 @@
 #include "traffic_light.h"
 
-#include <Arduino.h>
+#include "hal.h"
+#include "instrumentation.h"
 
 // constructor
 TrafficLight::TrafficLight(int red_pin, int yellow_pin, int green_pin)
     : light_pins{red_pin, yellow_pin, green_pin},
-      test_pins{INVALID_PIN, INVALID_PIN, INVALID_PIN},
-      intact_lights{true, true, true}, pattern{false, false, false}, cycle(),
-      activity_cycle(), event_manager() {
+      pattern{false, false, false}, cycle(), activity_cycle(), event_manager(),
+      output_stage(), defect_monitor() {
   // Initialize light pins
-  for (int i = 0; i < NUM_LIGHTS; i++) {
-    pinMode(light_pins[i], OUTPUT);
-    digitalWrite(light_pins[i], LOW);
+  output_stage.begin(light_pins, NUM_LIGHTS);
+
+  scheduler_node.callback = on_scheduler_timer;
+  scheduler_node.context = this;
+}
+
+TrafficLight::~TrafficLight() {
+  detach_scheduler();
+  if (conflict_monitor != nullptr) {
+    conflict_monitor->remove(*this);
+  }
+  if (state_publisher != nullptr) {
+    state_publisher->remove(*this);
   }
 }
 
@@ -24,19 +34,55 @@ bool TrafficLight::is_activity_cycle_enabled() {
 
 bool *TrafficLight::get_pattern() { return pattern; }
 
-// setters
-void TrafficLight::set_test_pin(int index, int pin) {
-  if (index < 0 || index >= NUM_LIGHTS) {
-    return; // Invalid index
+bool TrafficLight::get_next_deadline(unsigned long &deadline_ms) {
+  // Pattern set but not written yet
+  uint8_t mask, pwm_mask, level;
+  get_outputs(mask, pwm_mask, level);
+  if (output_stage.needs_commit(mask, pwm_mask, level)) {
+    deadline_ms = hal::millis();
+    return true;
   }
 
-  // Set new pin
-  test_pins[index] = pin;
+  bool found = cycle.get_next_deadline(deadline_ms);
 
-  // Configure new pin if valid
-  if (pin != INVALID_PIN) {
-    pinMode(pin, INPUT);
+  unsigned long effect_deadline_ms;
+  if (effect_player.get_next_deadline(effect_deadline_ms) ||
+      (conflict_monitor != nullptr &&
+       conflict_monitor->get_next_deadline(effect_deadline_ms))) {
+    deadline_ms = found ? hal::earliest(deadline_ms, effect_deadline_ms)
+                        : effect_deadline_ms;
+    found = true;
   }
+
+  unsigned long activity_deadline_ms;
+  if (activity_cycle.get_next_deadline(activity_deadline_ms)) {
+    deadline_ms = found ? hal::earliest(deadline_ms, activity_deadline_ms)
+                        : activity_deadline_ms;
+    found = true;
+  }
+
+  unsigned long test_deadline_ms;
+  if (defect_monitor.get_next_deadline(test_deadline_ms)) {
+    deadline_ms =
+        found ? hal::earliest(deadline_ms, test_deadline_ms) : test_deadline_ms;
+    found = true;
+  }
+
+  return found;
+}
+
+bool TrafficLight::is_light_intact(int index) {
+  return defect_monitor.is_intact(index);
+}
+
+int TrafficLight::get_plan_index() { return plan_index; }
+
+uint16_t TrafficLight::get_plan_id() { return plan_id; }
+
+// setters
+void TrafficLight::set_test_pin(int index, int pin) {
+  defect_monitor.set_pin(index, pin);
+  reschedule();
 }
 
 void TrafficLight::set_test_pins(int red_pin, int yellow_pin, int green_pin) {
@@ -45,11 +91,26 @@ void TrafficLight::set_test_pins(int red_pin, int yellow_pin, int green_pin) {
   set_test_pin(2, green_pin);
 }
 
+void TrafficLight::set_defect_sample_interval(unsigned long interval_ms) {
+  defect_monitor.set_sample_interval(interval_ms);
+  reschedule();
+}
+
+void TrafficLight::set_defect_filter_samples(uint8_t samples) {
+  defect_monitor.set_filter_samples(samples);
+}
+
+void TrafficLight::set_defect_threshold(int threshold) {
+  defect_monitor.set_threshold(threshold);
+}
+
 void TrafficLight::set_pattern(bool red_light, bool yellow_light,
                                bool green_light) {
   pattern[0] = red_light;
   pattern[1] = yellow_light;
   pattern[2] = green_light;
+  effect_player.stop();
+  reschedule();
 }
 
 void TrafficLight::set_cycle_repetitions_limit(
@@ -57,42 +118,312 @@ void TrafficLight::set_cycle_repetitions_limit(
   cycle.set_repetitions_limit(repetitions_limit);
 }
 
-void TrafficLight::set_cycle_phases(Phase *phases, int phase_count) {
+void TrafficLight::set_cycle_phases(const Phase *phases, int phase_count) {
   cycle.set_phases(phases, phase_count);
+  reschedule();
+}
+
+void TrafficLight::bind_cycle_phases(const Phase *phases, int phase_count) {
+  cycle.bind_phases(phases, phase_count);
+  reschedule();
+}
+
+void TrafficLight::bind_cycle_phases(const PackedPhase *phases,
+                                     int phase_count, bool in_flash) {
+  cycle.bind_phases(phases, phase_count, in_flash);
+  reschedule();
+}
+
+void TrafficLight::bind_cycle_phases(PhaseStreamBase &stream) {
+  cycle.bind_phases(stream);
+  reschedule();
+}
+
+void TrafficLight::set_cycle_actuations(const Actuation *actuations,
+                                        int actuation_count) {
+  cycle.set_actuations(actuations, actuation_count);
+  reschedule();
+}
+
+void TrafficLight::set_cycle_effects(const PhaseEffect *effects,
+                                     int effect_count) {
+  this->effects = effects;
+  this->effect_count = effects != nullptr ? effect_count : 0;
+  start_effect();
+  reschedule();
+}
+
+void TrafficLight::set_cycle_phase_storage(Phase *storage, int capacity) {
+  cycle.set_storage(storage, capacity);
+  reschedule();
 }
 
 void TrafficLight::set_activity_cycle_times(unsigned long active_time_ms,
                                             unsigned long inactive_time_ms) {
   activity_cycle.set_times(active_time_ms, inactive_time_ms);
+  reschedule();
 }
 
 void TrafficLight::set_auto_lights_off(bool enabled) {
   auto_lights_off = enabled;
 }
 
+void TrafficLight::set_timing_mode(TimingMode mode) {
+  timing_mode = mode;
+  cycle.set_timing_mode(mode);
+  activity_cycle.set_timing_mode(mode);
+}
+
+void TrafficLight::set_coordination(CoordinationClock *clock,
+                                    unsigned long offset_ms) {
+  cycle.set_coordination(clock, offset_ms);
+
+  // Show the phase at the position of the clock right away
+  if (cycle.is_enabled()) {
+    start_cycle(hal::millis());
+  }
+  reschedule();
+}
+
+void TrafficLight::set_plan_scheduler(PlanScheduler *scheduler) {
+  plan_scheduler = scheduler;
+  plan_index = -1;
+  if (plan_scheduler == nullptr)
+    return;
+
+  // Start with the current plan instead of finishing the running cycle
+  int index = plan_scheduler->get_plan_index();
+  const Plan *plan = plan_scheduler->get_plan(index);
+  if (plan == nullptr)
+    return;
+  plan_index = index;
+  cycle.bind_phases(plan->phases, plan->phase_count);
+  if (cycle.is_enabled()) {
+    start_cycle(hal::millis());
+  }
+  reschedule();
+}
+
+void TrafficLight::set_plan_id(uint16_t plan_id) {
+  this->plan_id = plan_id;
+}
+
 void TrafficLight::set_auto_recovery(bool enabled) {
-  auto_recovery_enabled = enabled;
+  defect_monitor.set_auto_recovery(enabled);
 }
 
 // controls
+bool TrafficLight::enable_port_output() {
+  return output_stage.enable_port_mode();
+}
+
+void TrafficLight::disable_port_output() { output_stage.disable_port_mode(); }
+
 void TrafficLight::enable_cycle() {
-  cycle.enable();
-  Phase *phase = cycle.get_phase();
-  if (phase != nullptr) {
-    set_pattern(phase->pattern[0], phase->pattern[1], phase->pattern[2]);
-  }
+  start_cycle(hal::millis());
+  reschedule();
 }
 
 void TrafficLight::disable_cycle() {
   cycle.disable();
+  effect_player.stop();
   if (auto_lights_off) {
     set_pattern(false, false, false);
   }
+  reschedule();
+}
+
+void TrafficLight::enable_activity_cycle() {
+  activity_cycle.enable();
+  reschedule();
+}
+
+void TrafficLight::disable_activity_cycle() {
+  activity_cycle.disable();
+  reschedule();
+}
+
+// state
+void TrafficLight::save_state(StateSnapshot &snapshot) {
+  unsigned long now = hal::millis();
+
+  snapshot.plan_id = plan_id;
+  snapshot.phase_count = cycle.get_phase_count();
+  snapshot.phase_index = 0;
+  snapshot.flags = 0;
+  snapshot.pattern = get_pattern_mask();
+  snapshot.defect_mask = defect_monitor.get_defect_mask();
+  snapshot.phase_elapsed_ms = 0;
+  snapshot.repetitions_count = cycle.get_repetitions_count();
+  snapshot.activity_elapsed_ms = 0;
+
+  if (cycle.is_enabled()) {
+    snapshot.flags |= (1 << StateSnapshot::FLAG_CYCLE_ENABLED);
+    snapshot.phase_index = cycle.get_phase_index();
+    snapshot.phase_elapsed_ms = now - cycle.get_phase_start_time();
+  }
+  if (activity_cycle.is_enabled()) {
+    snapshot.flags |= (1 << StateSnapshot::FLAG_ACTIVITY_CYCLE_ENABLED);
+    if (activity_cycle.get_state() == ActivityCycleState::INACTIVE) {
+      snapshot.flags |= (1 << StateSnapshot::FLAG_INACTIVE);
+    }
+    snapshot.activity_elapsed_ms = now - activity_cycle.get_state_start_time();
+  }
+}
+
+void TrafficLight::get_shared_state(SharedLightState &state) {
+  state.plan_id = plan_id;
+  state.phase_index = 0;
+  state.flags = 0;
+  state.pattern = get_pattern_mask();
+  state.intact_lights = ~defect_monitor.get_defect_mask() & 0x07;
+  state.reserved = 0;
+  state.phase_start_ms = 0;
+  state.repetitions_count = cycle.get_repetitions_count();
+
+  if (cycle.is_enabled()) {
+    state.flags |= (1 << SharedLightState::FLAG_CYCLE_ENABLED);
+    state.phase_index = cycle.get_phase_index();
+    state.phase_start_ms = cycle.get_phase_start_time();
+  }
+  if (activity_cycle.is_enabled()) {
+    state.flags |= (1 << SharedLightState::FLAG_ACTIVITY_CYCLE_ENABLED);
+    if (activity_cycle.get_state() == ActivityCycleState::INACTIVE) {
+      state.flags |= (1 << SharedLightState::FLAG_INACTIVE);
+    }
+  }
+  if (conflict_monitor != nullptr && conflict_monitor->is_fail_safe()) {
+    state.flags |= (1 << SharedLightState::FLAG_FAIL_SAFE);
+  }
+}
+
+size_t TrafficLight::save_state(uint8_t *buffer, size_t size) {
+  StateSnapshot snapshot;
+  save_state(snapshot);
+  return write_state_snapshot(snapshot, buffer, size);
+}
+
+bool TrafficLight::restore_state(const StateSnapshot &snapshot) {
+  bool cycle_enabled =
+      snapshot.flags & (1 << StateSnapshot::FLAG_CYCLE_ENABLED);
+
+  // Check everything before changing anything
+  if (snapshot.plan_id != plan_id ||
+      snapshot.phase_count != static_cast<uint32_t>(cycle.get_phase_count()) ||
+      (cycle_enabled && snapshot.phase_index >= snapshot.phase_count)) {
+    return false;
+  }
+
+  if (snapshot.flags & (1 << StateSnapshot::FLAG_ACTIVITY_CYCLE_ENABLED)) {
+    activity_cycle.restore(
+        (snapshot.flags & (1 << StateSnapshot::FLAG_INACTIVE))
+            ? ActivityCycleState::INACTIVE
+            : ActivityCycleState::ACTIVE,
+        snapshot.activity_elapsed_ms);
+  } else {
+    activity_cycle.disable();
+  }
+
+  if (cycle_enabled) {
+    cycle.restore(snapshot.phase_index, snapshot.phase_elapsed_ms,
+                  snapshot.repetitions_count);
+  } else {
+    cycle.disable();
+  }
+
+  // Show the pattern right away instead of waiting for update(), a
+  // coordinated cycle may have moved on to another phase
+  defect_monitor.restore(snapshot.defect_mask);
+  Phase *phase = cycle.get_phase();
+  if (phase != nullptr) {
+    for (int i = 0; i < NUM_LIGHTS; i++) {
+      pattern[i] = phase->pattern[i];
+    }
+  } else {
+    for (int i = 0; i < NUM_LIGHTS; i++) {
+      pattern[i] = snapshot.pattern & (1 << i);
+    }
+  }
+  start_effect();
+  commit_outputs();
+
+  reschedule();
+  return true;
+}
+
+bool TrafficLight::restore_state(const uint8_t *buffer, size_t size) {
+  StateSnapshot snapshot;
+  if (!read_state_snapshot(buffer, size, snapshot))
+    return false;
+  return restore_state(snapshot);
+}
+
+// scheduler
+void TrafficLight::attach_scheduler(TimerWheel &scheduler) {
+  detach_scheduler();
+  this->scheduler = &scheduler;
+  reschedule();
+}
+
+void TrafficLight::detach_scheduler() {
+  if (scheduler == nullptr)
+    return;
+  scheduler->cancel(scheduler_node);
+  scheduler = nullptr;
+}
+
+void TrafficLight::reschedule() {
+  if (scheduler == nullptr)
+    return;
+
+  unsigned long deadline_ms;
+  if (get_next_deadline(deadline_ms)) {
+    scheduler->schedule(scheduler_node, deadline_ms);
+  } else {
+    scheduler->cancel(scheduler_node);
+  }
 }
 
-void TrafficLight::enable_activity_cycle() { activity_cycle.enable(); }
+void TrafficLight::on_scheduler_timer(void *context) {
+  static_cast<TrafficLight *>(context)->update();
+}
 
-void TrafficLight::disable_activity_cycle() { activity_cycle.disable(); }
+// conflict monitor
+void TrafficLight::set_conflict_monitor(ConflictMonitorBase *monitor,
+                                        int head) {
+  conflict_monitor = monitor;
+  conflict_head = head;
+  reschedule();
+}
+
+void TrafficLight::enter_fail_safe() {
+  bool caused = conflict_monitor->get_conflict_heads() & (1UL << conflict_head);
+  cycle.disable();
+  activity_cycle.disable();
+  set_pattern(false, false, false);
+  output_stage.commit(conflict_monitor->get_fail_safe_mask(hal::millis()));
+
+  if (caused) {
+    emit(EventName::CONFLICT);
+  }
+  publish_state();
+}
+
+// state publisher
+void TrafficLight::set_state_publisher(StatePublisher *publisher, int slot) {
+  state_publisher = publisher;
+  state_slot = slot;
+  publish_state();
+}
+
+void TrafficLight::publish_state() {
+  if (state_publisher == nullptr)
+    return;
+
+  SharedLightState state;
+  get_shared_state(state);
+  state_publisher->publish(state_slot, state);
+}
 
 // events
 void TrafficLight::register_event(EventName name, void (*callback)()) {
@@ -103,15 +434,127 @@ void TrafficLight::unregister_event(EventName name) {
   event_manager.disconnect(name);
 }
 
+void TrafficLight::subscribe_event(EventListener &listener) {
+  event_manager.subscribe(listener);
+}
+
+void TrafficLight::subscribe_all_events(EventListener &listener) {
+  event_manager.subscribe_all(listener);
+}
+
+void TrafficLight::unsubscribe_event(EventListener &listener) {
+  event_manager.unsubscribe(listener);
+}
+
+void TrafficLight::set_event_queue(EventQueueBase *queue) {
+  event_manager.set_queue(queue);
+}
+
+void TrafficLight::emit(EventName name) {
+  instrumentation::count_event(name);
+  if (!event_manager.is_subscribed(name))
+    return;
+
+  EventPayload payload = {name, this, -1, -1, cycle.get_phase_index(),
+                          hal::millis()};
+  event_manager.emit(payload);
+}
+
 // update
 void TrafficLight::update() {
-  // Update activity cycle
+  instrumentation::ScopeTimer timer(
+      instrumentation::Stage::TRAFFIC_LIGHT_UPDATE);
+
+  // Handle due changes in the order of their deadlines. Only with
+  // ABSOLUTE_REPLAY a late update runs through several changes per cycle.
+  if (plan_scheduler != nullptr) {
+    update_plan();
+  }
+
+  // Sample detectors on every update, so short actuations are not missed
+  cycle.poll_detectors();
+
+  bool replay = (timing_mode == TimingMode::ABSOLUTE_REPLAY);
+  bool activity_cycle_done = false;
+  bool cycle_done = false;
+  unsigned long now = hal::millis();
+
+  for (int step = 0; step < MAX_CATCH_UP_STEPS; step++) {
+    bool activity_cycle_due =
+        !activity_cycle_done && activity_cycle.is_behind(now);
+    bool cycle_due = !cycle_done && cycle.is_behind(now);
+
+    if (activity_cycle_due && cycle_due) {
+      unsigned long activity_deadline_ms, cycle_deadline_ms;
+      activity_cycle.get_next_deadline(activity_deadline_ms);
+      cycle.get_next_deadline(cycle_deadline_ms);
+      activity_cycle_due =
+          hal::time_reached(cycle_deadline_ms, activity_deadline_ms);
+    }
+
+    if (activity_cycle_due) {
+      update_activity_cycle();
+      activity_cycle_done = !replay;
+    } else if (cycle_due) {
+      update_cycle();
+      cycle_done = !replay;
+    } else {
+      break;
+    }
+  }
+
+  // Also catches reads failed outside of update(), e.g. by restore_state()
+  if (cycle.has_read_failed()) {
+    on_cycle_read_failed();
+  }
+
+  // power lights, only written if the pattern changed
+  if (effect_player.is_playing()) {
+    effect_player.update(now);
+  }
+  commit_outputs();
+
+  // Test for defects if any test pin is configured
+  if (defect_monitor.has_pins()) {
+    test_for_defekt_lights();
+  }
+
+  publish_state();
+  reschedule();
+}
+
+void TrafficLight::idle(unsigned long max_idle_ms) {
+  unsigned long now = hal::millis();
+  unsigned long deadline_ms = now + max_idle_ms;
+
+  unsigned long next_deadline_ms;
+  if (get_next_deadline(next_deadline_ms)) {
+    deadline_ms = hal::earliest(deadline_ms, next_deadline_ms);
+  }
+
+  hal::idle_until(deadline_ms);
+}
+
+void TrafficLight::update_activity_cycle() {
   activity_cycle.update();
   if (activity_cycle.has_state_changed()) {
     on_activity_cycle_state_changed();
   }
+}
+
+void TrafficLight::update_plan() {
+  int index = plan_scheduler->get_plan_index();
+  if (index == plan_index)
+    return;
 
-  // Update cycle
+  const Plan *plan = plan_scheduler->get_plan(index);
+  if (plan == nullptr)
+    return;
+  plan_index = index;
+  cycle.queue_phases(plan->phases, plan->phase_count);
+}
+
+void TrafficLight::update_cycle() {
   cycle.update();
 
   // Check for cycle events
@@ -124,18 +567,18 @@ void TrafficLight::update() {
   if (cycle.has_reached_repetitions_limit()) {
     on_cycle_reached_repetitions_limit();
   }
+}
 
-  // power lights
-  for (int i = 0; i < 3; i++) {
-    digitalWrite(light_pins[i], pattern[i] ? HIGH : LOW);
+void TrafficLight::start_cycle(unsigned long start_time_ms) {
+  cycle.enable_at(start_time_ms);
+  if (cycle.has_read_failed()) {
+    on_cycle_read_failed();
+    return;
   }
-
-  // Test for defects if any test pin is configured
-  for (int i = 0; i < NUM_LIGHTS; i++) {
-    if (test_pins[i] != INVALID_PIN) {
-      test_for_defekt_lights();
-      break;
-    }
+  Phase *phase = cycle.get_phase();
+  if (phase != nullptr) {
+    set_pattern(phase->pattern[0], phase->pattern[1], phase->pattern[2]);
+    start_effect();
   }
 }
 
@@ -144,14 +587,15 @@ void TrafficLight::on_activity_cycle_state_changed() {
 
   // enable/disable cycle and emit events
   if (state == ActivityCycleState::ACTIVE) {
-    enable_cycle();
-    event_manager.emit(EventName::ACTIVITY_CYCLE_TO_ACTIVE);
+    // Start the cycle with the state, so a late update does not delay it
+    start_cycle(activity_cycle.get_state_start_time());
+    emit(EventName::ACTIVITY_CYCLE_TO_ACTIVE);
   } else if (state == ActivityCycleState::INACTIVE) {
     disable_cycle();
-    event_manager.emit(EventName::ACTIVITY_CYCLE_TO_INACTIVE);
+    emit(EventName::ACTIVITY_CYCLE_TO_INACTIVE);
   }
 
-  event_manager.emit(EventName::ACTIVITY_CYCLE_STATE_CHANGED);
+  emit(EventName::ACTIVITY_CYCLE_STATE_CHANGED);
 }
 
 void TrafficLight::on_cycle_phase_changed() {
@@ -161,19 +605,79 @@ void TrafficLight::on_cycle_phase_changed() {
     return;
 
   set_pattern(phase->pattern[0], phase->pattern[1], phase->pattern[2]);
+  start_effect();
 
-  event_manager.emit(EventName::CYCLE_PHASE_CHANGED);
+  emit(EventName::CYCLE_PHASE_CHANGED);
 }
 
 void TrafficLight::on_cycle_finished() {
-  event_manager.emit(EventName::CYCLE_FINISHED);
+  emit(EventName::CYCLE_FINISHED);
 }
 
 void TrafficLight::on_cycle_reached_repetitions_limit() {
+  effect_player.stop();
   if (auto_lights_off) {
     set_pattern(false, false, false);
   }
-  event_manager.emit(EventName::CYCLE_REACHED_REPETITIONS_LIMIT);
+  emit(EventName::CYCLE_REACHED_REPETITIONS_LIMIT);
+}
+
+void TrafficLight::on_cycle_read_failed() {
+  // Stop traffic instead of repeating the last phase, e.g. a green
+  set_pattern(true, false, false);
+  emit(EventName::CYCLE_READ_FAILED);
+}
+
+void TrafficLight::start_effect() {
+  effect_player.stop();
+  if (!cycle.is_enabled())
+    return;
+
+  int index = cycle.get_phase_index();
+  for (int i = 0; i < effect_count; i++) {
+    if (effects[i].phase_index == index) {
+      effect_player.start(&effects[i], cycle.get_phase_start_time());
+      effect_player.update(hal::millis());
+      return;
+    }
+  }
+}
+
+void TrafficLight::get_outputs(uint8_t &mask, uint8_t &pwm_mask,
+                               uint8_t &level) {
+  mask = get_pattern_mask();
+  pwm_mask = 0;
+  level = 0;
+
+  if (conflict_monitor != nullptr && conflict_monitor->is_fail_safe()) {
+    mask = conflict_monitor->get_fail_safe_mask(hal::millis());
+  } else if (effect_player.is_playing()) {
+    pwm_mask = effect_player.get_pwm_mask(mask);
+    level = effect_player.get_level();
+    mask = effect_player.get_mask(mask);
+  }
+}
+
+void TrafficLight::commit_outputs() {
+  uint8_t mask, pwm_mask, level;
+  get_outputs(mask, pwm_mask, level);
+
+  // A rejected pattern switched all heads to the fail-safe flash
+  if (conflict_monitor != nullptr && !conflict_monitor->is_fail_safe() &&
+      !conflict_monitor->check(conflict_head, mask | pwm_mask)) {
+    return;
+  }
+
+  output_stage.commit(mask, pwm_mask, level);
+}
+
+uint8_t TrafficLight::get_pattern_mask() {
+  uint8_t mask = 0;
+  for (int i = 0; i < NUM_LIGHTS; i++) {
+    if (pattern[i])
+      mask |= (1 << i);
+  }
+  return mask;
 }
 
 void TrafficLight::test_for_defekt_lights() {
@@ -184,39 +688,21 @@ void TrafficLight::test_for_defekt_lights() {
       EventName::RED_LIGHT_RECOVERED, EventName::YELLOW_LIGHT_RECOVERED,
       EventName::GREEN_LIGHT_RECOVERED};
 
-  static unsigned long last_test_time = 0;
-  const unsigned long test_interval = 100; // Test every 100ms
-  unsigned long now = millis();
-  unsigned long elapsed = (now - last_test_time);
-
-  // Throttle the test frequency
-  if (elapsed < test_interval) {
-    return;
-  }
-  last_test_time = now;
+  instrumentation::ScopeTimer timer(instrumentation::Stage::DEFECT_TEST);
 
-  for (int i = 0; i < NUM_LIGHTS; i++) {
-    if (test_pins[i] == INVALID_PIN) {
-      continue; // No test pin for this light
-    }
+  // Only test lamps that are lit, not those in a flash off time or dimmed
+  uint8_t mask, pwm_mask, level;
+  get_outputs(mask, pwm_mask, level);
+  uint8_t lit_mask = (mask & ~pwm_mask) | (level >= 128 ? pwm_mask : 0);
 
-    // Only test lights that are supposed to be on
-    if (!pattern[i]) {
-      continue;
-    }
+  int index = defect_monitor.update(lit_mask);
+  if (index < 0) {
+    return; // No light changed its state
+  }
 
-    int reading = analogRead(test_pins[i]);
-    bool is_defect = (reading > DEFECT_THRESHOLD);
-
-    if (is_defect && intact_lights[i]) {
-      // Light just became defective
-      intact_lights[i] = false;
-      event_manager.emit(defect_event_names[i]);
-    } else if (!is_defect && !intact_lights[i] && auto_recovery_enabled) {
-      // Light was defective but is now functioning and auto-recovery is
-      // enabled
-      intact_lights[i] = true;
-      event_manager.emit(recovered_event_names[i]);
-    }
+  if (defect_monitor.is_intact(index)) {
+    emit(recovered_event_names[index]);
+  } else {
+    emit(defect_event_names[index]);
   }
 }
\ No newline at end of file
@@ -2,25 +2,84 @@
 #define TRAFFIC_LIGHT_H
 
 #include "activity_cycle.h"
+#include "conflict_monitor.h"
 #include "cycle.h"
+#include "defect_monitor.h"
 #include "events.h"
+#include "output_stage.h"
+#include "phase_effect.h"
+#include "plan_scheduler.h"
+#include "state_publisher.h"
+#include "state_snapshot.h"
+#include "timer_wheel.h"
 
 class TrafficLight {
 private:
   static constexpr int NUM_LIGHTS = 3;
-  static constexpr int INVALID_PIN = -1;
-  static constexpr unsigned long DEFECT_THRESHOLD = 1000;
+  static constexpr int MAX_CATCH_UP_STEPS = 32; // Replayed changes per update
 
   int light_pins[NUM_LIGHTS];
-  int test_pins[NUM_LIGHTS];
-  bool intact_lights[NUM_LIGHTS];
   bool pattern[NUM_LIGHTS];
   Cycle cycle;
   ActivityCycle activity_cycle;
   EventManager event_manager;
+  OutputStage output_stage;
+  DefectMonitor<NUM_LIGHTS> defect_monitor;
 
   bool auto_lights_off = true;
-  bool auto_recovery_enabled = false;
+  uint16_t plan_id = 0;
+  TimingMode timing_mode = TimingMode::RELATIVE;
+  TimerWheel *scheduler = nullptr;
+  PlanScheduler *plan_scheduler = nullptr;
+  int plan_index = -1; // Plan last handed to the cycle
+  TimerNode scheduler_node;
+  const PhaseEffect *effects = nullptr; // Flashing and fading phases
+  int effect_count = 0;
+  EffectPlayer effect_player;
+  ConflictMonitorBase *conflict_monitor = nullptr;
+  int conflict_head = -1; // Index of this light in the conflict monitor
+  StatePublisher *state_publisher = nullptr;
+  int state_slot = -1; // Slot of this light in the state publisher
+
+  /**
+   * Updates the activity cycle and handles its state change.
+   */
+  void update_activity_cycle();
+
+  /**
+   * Hands the plan selected by the plan scheduler to the cycle when it
+   * changes.
+   */
+  void update_plan();
+
+  /**
+   * Updates the cycle and handles its events.
+   */
+  void update_cycle();
+
+  /**
+   * Enables the cycle and shows its first phase.
+   * @param start_time_ms The start time of the first phase in milliseconds.
+   */
+  void start_cycle(unsigned long start_time_ms);
+
+  /**
+   * Starts the effect of the current phase of the cycle, if it has one.
+   */
+  void start_effect();
+
+  /**
+   * Gets the lamps to write, with the effect of the phase applied and
+   * replaced by the fail-safe flash of the conflict monitor if it is active.
+   * Checking for conflicts is up to commit_outputs().
+   */
+  void get_outputs(uint8_t &mask, uint8_t &pwm_mask, uint8_t &level);
+
+  /**
+   * Writes the pattern to the lights, with the effect of the phase applied,
+   * unless the conflict monitor rejects it.
+   */
+  void commit_outputs();
 
   /**
    * Updates the activity cycle state.
@@ -43,11 +102,53 @@ private:
   void on_cycle_reached_repetitions_limit();
 
   /**
-   * Test the light pins by checking their analog readings.
-   * Updates the intact_lights array based on the readings.
+   * Shows red after the cycle stopped on a phase it could not read and emits
+   * the CYCLE_READ_FAILED event.
+   */
+  void on_cycle_read_failed();
+
+  /**
+   * Gets the current pattern as a bitmask.
+   * @return Bit i set if light i is on.
+   */
+  uint8_t get_pattern_mask();
+
+  /**
+   * Hands the state over to the state publisher, if any.
+   */
+  void publish_state();
+
+  /**
+   * Emits an event with this light as source, if anyone listens to it.
+   * @param name The name of the event.
+   */
+  void emit(EventName name);
+
+  /**
+   * Registers the next deadline with the scheduler, if attached.
+   */
+  void reschedule();
+
+  /**
+   * Updates the traffic light when its scheduler timer expires.
+   * @param context The traffic light.
+   */
+  static void on_scheduler_timer(void *context);
+
+  /**
+   * Samples the next test pin and emits defect and recovered events.
+   * Only lamps lit at the moment are sampled.
    */
   void test_for_defekt_lights();
 
+protected:
+  /**
+   * Sets the memory the cycle phases are copied to instead of the heap.
+   * @param storage Array for the phases, must outlive the traffic light.
+   * @param capacity Number of phases fitting into the array.
+   */
+  void set_cycle_phase_storage(Phase *storage, int capacity);
+
 public:
   /**
    * Constructor for the TrafficLight class.
@@ -57,6 +158,11 @@ public:
    */
   TrafficLight(int red_pin, int yellow_pin, int green_pin);
 
+  /**
+   * Destructor for the TrafficLight class, detaches it from its scheduler.
+   */
+  ~TrafficLight();
+
   /**
    * Checks if the cycle is enabled.
    * @return True if the cycle is enabled, false otherwise.
@@ -75,6 +181,34 @@ public:
    */
   bool *get_pattern();
 
+  /**
+   * Gets the point in time the traffic light next needs an update, i.e. the
+   * earliest phase change, activity state change or defect test.
+   * @param deadline_ms Set to the deadline in milliseconds.
+   * @return True if there is a deadline, false if nothing is scheduled.
+   */
+  bool get_next_deadline(unsigned long &deadline_ms);
+
+  /**
+   * Checks if a light is intact according to its test pin.
+   * @param index The index of the light (0: red, 1: yellow, 2: green).
+   * @return True if the light is intact or untested, false if it is defect.
+   */
+  bool is_light_intact(int index);
+
+  /**
+   * Gets the plan last selected by the plan scheduler. The cycle switches
+   * to it at the end of the running cycle.
+   * @return The index of the plan, -1 without a plan scheduler.
+   */
+  int get_plan_index();
+
+  /**
+   * Gets the id of the phases, see set_plan_id().
+   * @return The plan id.
+   */
+  uint16_t get_plan_id();
+
   /**
    * Sets the test pin for a specific light.
    * @param index The index of the light (0: red, 1: yellow, 2: green).
@@ -90,6 +224,26 @@ public:
    */
   void set_test_pins(int red_pin, int yellow_pin, int green_pin);
 
+  /**
+   * Sets the time between two defect tests. Each test reads the test pin of
+   * one light that is on, taking turns between the lights.
+   * @param interval_ms The time between tests in milliseconds.
+   */
+  void set_defect_sample_interval(unsigned long interval_ms);
+
+  /**
+   * Sets the number of consecutive readings needed before a light is
+   * reported defect or recovered.
+   * @param samples The number of readings, at least 1.
+   */
+  void set_defect_filter_samples(uint8_t samples);
+
+  /**
+   * Sets the analog reading above which a light counts as defect.
+   * @param threshold The analog reading.
+   */
+  void set_defect_threshold(int threshold);
+
   /**
    * Sets the pattern for the traffic light.
    * @param red_light The state of the red light.
@@ -111,7 +265,55 @@ public:
    * phases.
    * @param phase_count The number of phases in the sequence.
    */
-  void set_cycle_phases(Phase *phases, int phase_count);
+  void set_cycle_phases(const Phase *phases, int phase_count);
+
+  /**
+   * Uses phases for the cycle without copying them.
+   * @param phases An array of phases, must stay valid while it is used.
+   * @param phase_count The number of phases in the sequence.
+   */
+  void bind_cycle_phases(const Phase *phases, int phase_count);
+
+  /**
+   * Uses packed phases for the cycle without copying them, e.g. a table in
+   * flash declared with PROGMEM.
+   * @param phases An array of packed phases, must stay valid while it is used.
+   * @param phase_count The number of phases in the sequence.
+   * @param in_flash True if the array is stored in flash (PROGMEM).
+   */
+  void bind_cycle_phases(const PackedPhase *phases, int phase_count,
+                         bool in_flash = false);
+
+  /**
+   * Streams the phases of the cycle from external storage, e.g. an SD card,
+   * with constant memory use. Call the stream's refill() in loop(), so the
+   * next phases are read before they are needed.
+   * @param stream The stream, must stay valid while it is used.
+   */
+  void bind_cycle_phases(PhaseStreamBase &stream);
+
+  /**
+   * Makes phases of the cycle actuated by detectors, see Actuation.
+   * Detectors with a pin are read on every update(), detectors triggered
+   * from an interrupt are picked up on the next update(). Keep calling
+   * update() often instead of only at the deadlines, so actuations extend
+   * their phase right away.
+   * @param actuations The actuated phases, must stay valid while they are
+   * used. nullptr for fixed time phases only.
+   * @param actuation_count The number of actuated phases.
+   */
+  void set_cycle_actuations(const Actuation *actuations, int actuation_count);
+
+  /**
+   * Makes lamps of phases of the cycle flash or fade, see PhaseEffect.
+   * The effects are played by update() and end with their phase or when the
+   * pattern is set by set_pattern(). get_pattern() keeps returning the
+   * pattern of the phase.
+   * @param effects The effects, must stay valid while they are used.
+   * nullptr for steady lamps only.
+   * @param effect_count The number of effects.
+   */
+  void set_cycle_effects(const PhaseEffect *effects, int effect_count);
 
   /**
    * Sets the times for the active and inactive states of the activity cycle.
@@ -130,6 +332,44 @@ public:
    */
   void set_auto_lights_off(bool enabled);
 
+  /**
+   * Sets how the cycle and the activity cycle are scheduled when update()
+   * runs late. The absolute modes keep every phase on the schedule given by
+   * the start of the cycle and the phase durations, so delays do not add up.
+   * @param mode The timing mode, RELATIVE by default.
+   */
+  void set_timing_mode(TimingMode mode);
+
+  /**
+   * Ties the cycle to a coordination clock shared with other lights, so they
+   * keep fixed offsets to each other, e.g. for a green wave along a road.
+   * The phase shown is computed from the position within the coordinated
+   * cycle, so the offsets do not drift even if update() runs late.
+   * @param clock The coordination clock, must stay valid while it is used.
+   * nullptr to stop coordinating the cycle.
+   * @param offset_ms The start of the cycle after the reference of the clock
+   * in milliseconds.
+   */
+  void set_coordination(CoordinationClock *clock, unsigned long offset_ms = 0);
+
+  /**
+   * Lets a plan scheduler select the phases of the cycle by the time of day
+   * or week. The current plan is used right away, later changes are
+   * switched to when the running cycle ends. The phases of the plans are
+   * used in place, not copied.
+   * @param scheduler The plan scheduler, must stay valid while it is used.
+   * nullptr to keep the current phases.
+   */
+  void set_plan_scheduler(PlanScheduler *scheduler);
+
+  /**
+   * Sets an id for the phases of the cycle, stored in saved states. A state
+   * is only restored if it was saved with the same id, so a state of other
+   * phases is never applied.
+   * @param plan_id The plan id, 0 by default.
+   */
+  void set_plan_id(uint16_t plan_id);
+
   /**
    * Sets the state of the auto recovery feature for defected lights.
    * When enabled, the traffic light will automatically recover defected lights
@@ -138,6 +378,19 @@ public:
    */
   void set_auto_recovery(bool enabled);
 
+  /**
+   * Enables writing all light pins with a single port register access.
+   * All lights then switch at the same instant. Only possible if the
+   * backend supports it and all light pins share one port.
+   * @return True if port output is enabled, false otherwise.
+   */
+  bool enable_port_output();
+
+  /**
+   * Disables port output, the light pins are written one by one.
+   */
+  void disable_port_output();
+
   /**
    * Enables the cycle.
    */
@@ -158,6 +411,94 @@ public:
    */
   void disable_activity_cycle();
 
+  /**
+   * Saves the runtime state: the current phase, the time spent in it, the
+   * repetitions, the activity state, the pattern and the defect lights.
+   * @param snapshot Set to the state.
+   */
+  void save_state(StateSnapshot &snapshot);
+
+  /**
+   * Gets the live state for monitoring: the pattern, the current phase, the
+   * activity state and the intact lights.
+   * @param state Set to the state.
+   */
+  void get_shared_state(SharedLightState &state);
+
+  /**
+   * Saves the runtime state encoded for storage, see save_state() and
+   * write_state_snapshot().
+   * @param buffer The buffer to write to.
+   * @param size The size of the buffer, at least STATE_SNAPSHOT_SIZE.
+   * @return The number of bytes written, 0 if the buffer is too small.
+   */
+  size_t save_state(uint8_t *buffer, size_t size);
+
+  /**
+   * Restores a saved runtime state, e.g. on boot after a reset, and shows
+   * its pattern right away. Set up the phases, times and pins before. The
+   * state continues as if no time passed since it was saved. No events are
+   * emitted.
+   * @param snapshot The saved state.
+   * @return True if the state was restored, false if it belongs to another
+   * plan id or number of phases. The light is unchanged then.
+   */
+  bool restore_state(const StateSnapshot &snapshot);
+
+  /**
+   * Restores a runtime state saved by save_state(uint8_t *, size_t).
+   * @param buffer The buffer to read from.
+   * @param size The size of the buffer.
+   * @return True if the state was restored, false if the buffer holds no
+   * valid state or restore_state() rejected it.
+   */
+  bool restore_state(const uint8_t *buffer, size_t size);
+
+  /**
+   * Sets a queue deferring the events of this light.
+   * Events are then delivered when the queue's dispatch_events() is called
+   * instead of during update(), so slow callbacks do not delay the lights.
+   * @param queue The queue, nullptr to deliver events during update().
+   */
+  void set_event_queue(EventQueueBase *queue);
+
+  /**
+   * Attaches the traffic light to a scheduler.
+   * The scheduler then calls update() whenever the traffic light has a
+   * deadline, so only lights that change are updated. The traffic light must
+   * not be updated by other means while attached, except through update().
+   * @param scheduler The timer wheel to register with.
+   */
+  void attach_scheduler(TimerWheel &scheduler);
+
+  /**
+   * Detaches the traffic light from its scheduler.
+   */
+  void detach_scheduler();
+
+  /**
+   * Links the traffic light to a conflict monitor, called by
+   * ConflictMonitorBase::add() and remove().
+   * @param monitor The monitor, nullptr to unlink.
+   * @param head The index of the light in the monitor.
+   */
+  void set_conflict_monitor(ConflictMonitorBase *monitor, int head);
+
+  /**
+   * Links the traffic light to a state publisher and publishes the state,
+   * called by the publisher when the light is added or removed.
+   * @param publisher The publisher, nullptr to unlink.
+   * @param slot The slot of the light in the publisher.
+   */
+  void set_state_publisher(StatePublisher *publisher, int slot);
+
+  /**
+   * Stops the cycles and shows the fail-safe flash of the conflict monitor,
+   * called by the monitor when it detects a conflict. The pattern is turned
+   * off, so the light stays dark after the monitor is reset.
+   */
+  void enter_fail_safe();
+
   /**
    * Registers an event callback for a specific event.
    * @param name The name of the event.
@@ -171,11 +512,78 @@ public:
    */
   void unregister_event(EventName name);
 
+  /**
+   * Subscribes a listener to its event, in addition to the registered
+   * callback and other listeners. The listener receives its context and a
+   * payload with this light as source.
+   * @param listener The listener, must stay valid while subscribed.
+   */
+  void subscribe_event(EventListener &listener);
+
+  /**
+   * Subscribes a listener to every event of this light, e.g. to record them.
+   * @param listener The listener, must stay valid while subscribed.
+   */
+  void subscribe_all_events(EventListener &listener);
+
+  /**
+   * Unsubscribes a listener from its event or from every event.
+   * @param listener The listener.
+   */
+  void unsubscribe_event(EventListener &listener);
+
   /**
    * Updates the state of the traffic light, checking for light defects and
    * updating the activity cycle.
    */
   void update();
+
+  /**
+   * Idles until the next deadline, so the CPU is not spent on polling.
+   * Call update() afterwards.
+   * @param max_idle_ms The maximum time in milliseconds to idle, used when
+   * nothing is scheduled or to stay responsive to other work.
+   */
+  void idle(unsigned long max_idle_ms = 1000);
+};
+
+/**
+ * Traffic light with storage for a fixed number of cycle phases, never uses
+ * the heap.
+ */
+template <int CAPACITY> class StaticTrafficLight : public TrafficLight {
+  static_assert(CAPACITY > 0, "Capacity must be positive");
+
+private:
+  Phase phase_storage[CAPACITY];
+
+public:
+  StaticTrafficLight(int red_pin, int yellow_pin, int green_pin)
+      : TrafficLight(red_pin, yellow_pin, green_pin) {
+    set_cycle_phase_storage(phase_storage, CAPACITY);
+  }
+
+  using TrafficLight::set_cycle_phases;
+
+  /**
+   * Sets the phases for the cycle, checking at compile time that they fit.
+   * @param phases An array of phases.
+   */
+  template <int N> void set_cycle_phases(const Phase (&phases)[N]) {
+    static_assert(N <= CAPACITY, "Phases exceed the capacity");
+    TrafficLight::set_cycle_phases(phases, N);
+  }
+
+  /**
+   * Sets the phases for the cycle, checking at compile time that they fit
+   * and that every phase is valid, see are_phases_valid(). The table must be
+   * a constexpr array at namespace scope, e.g.
+   * set_cycle_phases<decltype(PHASES), PHASES>().
+   */
+  template <typename TABLE, TABLE &PHASES> void set_cycle_phases() {
+    static_assert(are_phases_valid(PHASES), "Invalid phase table");
+    set_cycle_phases(PHASES);
+  }
 };
 
 #endif
\ No newline at end of file
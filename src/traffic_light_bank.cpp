@@ -0,0 +1,418 @@
+#include "traffic_light_bank.h"
+#include "hal.h"
+#include "instrumentation.h"
+
+TrafficLightBankBase::TrafficLightBankBase(const Storage &storage,
+                                           int capacity)
+    : storage(storage), capacity(capacity), count(0), event_queue(nullptr) {}
+
+BankedTrafficLight TrafficLightBankBase::add(int red_pin, int yellow_pin,
+                                             int green_pin) {
+  if (count >= capacity) {
+    return BankedTrafficLight(nullptr, -1); // Bank is full
+  }
+
+  int slot = count++;
+  int *pins = storage.light_pins[slot];
+  pins[0] = red_pin;
+  pins[1] = yellow_pin;
+  pins[2] = green_pin;
+
+  storage.flags[slot] = (1 << FLAG_AUTO_LIGHTS_OFF);
+  storage.patterns[slot] = 0;
+  storage.written_patterns[slot] = 0;
+  storage.phases[slot] = nullptr;
+  storage.phase_counts[slot] = 0;
+  storage.phase_indices[slot] = 0;
+  storage.phase_deadlines[slot] = 0;
+  storage.repetitions_limits[slot] = 0;
+  storage.repetitions_counts[slot] = 0;
+  storage.activity_deadlines[slot] = 0;
+  storage.active_times[slot] = 0;
+  storage.inactive_times[slot] = 0;
+  storage.event_managers[slot].set_queue(event_queue);
+
+  // Initialize light pins
+  for (int i = 0; i < NUM_LIGHTS; i++) {
+    hal::pin_mode(pins[i], PinMode::OUTPUT_MODE);
+    hal::digital_write(pins[i], false);
+  }
+
+  return BankedTrafficLight(this, slot);
+}
+
+BankedTrafficLight TrafficLightBankBase::get(int slot) {
+  if (slot < 0 || slot >= count)
+    return BankedTrafficLight(nullptr, -1);
+  return BankedTrafficLight(this, slot);
+}
+
+int TrafficLightBankBase::get_count() { return count; }
+
+int TrafficLightBankBase::get_capacity() { return capacity; }
+
+void TrafficLightBankBase::set_event_queue(EventQueueBase *queue) {
+  event_queue = queue;
+  for (int slot = 0; slot < count; slot++) {
+    storage.event_managers[slot].set_queue(queue);
+  }
+}
+
+// update
+void TrafficLightBankBase::update() {
+  unsigned long now = hal::millis();
+  for (int slot = 0; slot < count; slot++) {
+    update_slot(slot, now);
+  }
+}
+
+void TrafficLightBankBase::update(int slot) {
+  if (slot < 0 || slot >= count)
+    return;
+  update_slot(slot, hal::millis());
+}
+
+bool TrafficLightBankBase::get_next_deadline(unsigned long &deadline_ms) {
+  bool found = false;
+
+  for (int slot = 0; slot < count; slot++) {
+    unsigned long slot_deadline_ms;
+    if (get_next_deadline(slot, slot_deadline_ms)) {
+      deadline_ms = found ? hal::earliest(deadline_ms, slot_deadline_ms)
+                          : slot_deadline_ms;
+      found = true;
+    }
+  }
+
+  return found;
+}
+
+void TrafficLightBankBase::idle(unsigned long max_idle_ms) {
+  unsigned long deadline_ms = hal::millis() + max_idle_ms;
+
+  unsigned long next_deadline_ms;
+  if (get_next_deadline(next_deadline_ms)) {
+    deadline_ms = hal::earliest(deadline_ms, next_deadline_ms);
+  }
+
+  hal::idle_until(deadline_ms);
+}
+
+void TrafficLightBankBase::update_slot(int slot, unsigned long now) {
+  if ((storage.flags[slot] & (1 << FLAG_ACTIVITY_ENABLED)) &&
+      hal::time_reached(now, storage.activity_deadlines[slot])) {
+    toggle_activity(slot, now);
+  }
+
+  if ((storage.flags[slot] & (1 << FLAG_CYCLE_ENABLED)) &&
+      hal::time_reached(now, storage.phase_deadlines[slot])) {
+    instrumentation::record_lateness(now - storage.phase_deadlines[slot]);
+    advance_phase(slot, now);
+  }
+
+  if (storage.patterns[slot] != storage.written_patterns[slot]) {
+    write_pattern(slot);
+  }
+}
+
+void TrafficLightBankBase::toggle_activity(int slot, unsigned long now) {
+  // Toggle state and enable/disable cycle
+  storage.flags[slot] ^= (1 << FLAG_INACTIVE);
+  if (storage.flags[slot] & (1 << FLAG_INACTIVE)) {
+    storage.activity_deadlines[slot] = now + storage.inactive_times[slot];
+    disable_cycle(slot);
+    emit(slot, EventName::ACTIVITY_CYCLE_TO_INACTIVE);
+  } else {
+    storage.activity_deadlines[slot] = now + storage.active_times[slot];
+    enable_cycle(slot);
+    emit(slot, EventName::ACTIVITY_CYCLE_TO_ACTIVE);
+  }
+
+  emit(slot, EventName::ACTIVITY_CYCLE_STATE_CHANGED);
+}
+
+void TrafficLightBankBase::advance_phase(int slot, unsigned long now) {
+  const Phase *phases = storage.phases[slot];
+  if (phases == nullptr)
+    return;
+
+  int phase_index = storage.phase_indices[slot] + 1;
+  bool finished = false;
+  bool reached_limit = false;
+
+  // Check if cycle finished
+  if (phase_index >= storage.phase_counts[slot]) {
+    finished = true;
+    phase_index = 0;
+    storage.repetitions_counts[slot]++;
+
+    // Check repetitions limit
+    unsigned long limit = storage.repetitions_limits[slot];
+    if (limit > 0 && storage.repetitions_counts[slot] >= limit) {
+      reached_limit = true;
+      storage.flags[slot] &= ~(1 << FLAG_CYCLE_ENABLED);
+    }
+  }
+
+  storage.phase_indices[slot] = phase_index;
+  storage.phase_deadlines[slot] = now + phases[phase_index].duration_ms;
+
+  // A cycle stopped by its limit has no current phase to show
+  if (!reached_limit) {
+    const bool *pattern = phases[phase_index].pattern;
+    set_pattern(slot, pattern[0], pattern[1], pattern[2]);
+    emit(slot, EventName::CYCLE_PHASE_CHANGED);
+  }
+  if (finished) {
+    emit(slot, EventName::CYCLE_FINISHED);
+  }
+  if (reached_limit) {
+    if (storage.flags[slot] & (1 << FLAG_AUTO_LIGHTS_OFF)) {
+      storage.patterns[slot] = 0;
+    }
+    emit(slot, EventName::CYCLE_REACHED_REPETITIONS_LIMIT);
+  }
+}
+
+void TrafficLightBankBase::start_cycle(int slot, unsigned long now) {
+  storage.phase_indices[slot] = 0;
+  if (storage.phases[slot] == nullptr)
+    return;
+
+  const Phase &phase = storage.phases[slot][0];
+  storage.phase_deadlines[slot] = now + phase.duration_ms;
+  set_pattern(slot, phase.pattern[0], phase.pattern[1], phase.pattern[2]);
+}
+
+void TrafficLightBankBase::emit(int slot, EventName name) {
+  instrumentation::count_event(name);
+  EventManager &event_manager = storage.event_managers[slot];
+  if (!event_manager.is_subscribed(name))
+    return;
+
+  int phase_index = is_cycle_enabled(slot) && storage.phases[slot] != nullptr
+                        ? storage.phase_indices[slot]
+                        : -1;
+  EventPayload payload = {name, this, slot, -1, phase_index, hal::millis()};
+  event_manager.emit(payload);
+}
+
+void TrafficLightBankBase::write_pattern(int slot) {
+  uint8_t pattern = storage.patterns[slot];
+  uint8_t changed = pattern ^ storage.written_patterns[slot];
+  const int *pins = storage.light_pins[slot];
+
+  for (int i = 0; i < NUM_LIGHTS; i++) {
+    if (changed & (1 << i)) {
+      hal::digital_write(pins[i], (pattern & (1 << i)) != 0);
+    }
+  }
+  storage.written_patterns[slot] = pattern;
+}
+
+// per light operations
+bool TrafficLightBankBase::is_cycle_enabled(int slot) {
+  return (storage.flags[slot] & (1 << FLAG_CYCLE_ENABLED)) != 0;
+}
+
+bool TrafficLightBankBase::is_activity_cycle_enabled(int slot) {
+  return (storage.flags[slot] & (1 << FLAG_ACTIVITY_ENABLED)) != 0;
+}
+
+uint8_t TrafficLightBankBase::get_pattern_mask(int slot) {
+  return storage.patterns[slot];
+}
+
+void TrafficLightBankBase::set_pattern(int slot, bool red_light,
+                                       bool yellow_light, bool green_light) {
+  storage.patterns[slot] =
+      (red_light ? 1 : 0) | (yellow_light ? 2 : 0) | (green_light ? 4 : 0);
+}
+
+void TrafficLightBankBase::set_cycle_repetitions_limit(
+    int slot, unsigned long repetitions_limit) {
+  storage.repetitions_limits[slot] = repetitions_limit;
+}
+
+void TrafficLightBankBase::set_cycle_phases(int slot, const Phase *phases,
+                                            int phase_count) {
+  if (phase_count <= 0 || phases == nullptr) {
+    // Disable the cycle if invalid input
+    storage.phases[slot] = nullptr;
+    storage.phase_counts[slot] = 0;
+    return;
+  }
+
+  storage.phases[slot] = phases;
+  storage.phase_counts[slot] = phase_count;
+  storage.phase_indices[slot] = 0;
+
+  // Reset timing
+  if (is_cycle_enabled(slot)) {
+    storage.phase_deadlines[slot] = hal::millis() + phases[0].duration_ms;
+  }
+}
+
+void TrafficLightBankBase::set_activity_cycle_times(
+    int slot, unsigned long active_time_ms, unsigned long inactive_time_ms) {
+  storage.active_times[slot] = active_time_ms;
+  storage.inactive_times[slot] = inactive_time_ms;
+}
+
+void TrafficLightBankBase::set_auto_lights_off(int slot, bool enabled) {
+  if (enabled) {
+    storage.flags[slot] |= (1 << FLAG_AUTO_LIGHTS_OFF);
+  } else {
+    storage.flags[slot] &= ~(1 << FLAG_AUTO_LIGHTS_OFF);
+  }
+}
+
+void TrafficLightBankBase::enable_cycle(int slot) {
+  storage.flags[slot] |= (1 << FLAG_CYCLE_ENABLED);
+  storage.repetitions_counts[slot] = 0;
+  start_cycle(slot, hal::millis());
+}
+
+void TrafficLightBankBase::disable_cycle(int slot) {
+  storage.flags[slot] &= ~(1 << FLAG_CYCLE_ENABLED);
+  storage.phase_indices[slot] = 0;
+  if (storage.flags[slot] & (1 << FLAG_AUTO_LIGHTS_OFF)) {
+    storage.patterns[slot] = 0;
+  }
+}
+
+void TrafficLightBankBase::enable_activity_cycle(int slot) {
+  storage.flags[slot] |= (1 << FLAG_ACTIVITY_ENABLED);
+  storage.flags[slot] &= ~(1 << FLAG_INACTIVE);
+  storage.activity_deadlines[slot] = hal::millis() + storage.active_times[slot];
+}
+
+void TrafficLightBankBase::disable_activity_cycle(int slot) {
+  storage.flags[slot] &= ~((1 << FLAG_ACTIVITY_ENABLED) | (1 << FLAG_INACTIVE));
+}
+
+void TrafficLightBankBase::register_event(int slot, EventName name,
+                                          void (*callback)()) {
+  storage.event_managers[slot].connect(name, callback);
+}
+
+void TrafficLightBankBase::unregister_event(int slot, EventName name) {
+  storage.event_managers[slot].disconnect(name);
+}
+
+void TrafficLightBankBase::subscribe_event(int slot, EventListener &listener) {
+  storage.event_managers[slot].subscribe(listener);
+}
+
+void TrafficLightBankBase::unsubscribe_event(int slot,
+                                             EventListener &listener) {
+  storage.event_managers[slot].unsubscribe(listener);
+}
+
+bool TrafficLightBankBase::get_next_deadline(int slot,
+                                             unsigned long &deadline_ms) {
+  uint8_t flags = storage.flags[slot];
+
+  // Pattern set but not written yet
+  if (storage.patterns[slot] != storage.written_patterns[slot]) {
+    deadline_ms = hal::millis();
+    return true;
+  }
+
+  bool found = false;
+  if (flags & (1 << FLAG_ACTIVITY_ENABLED)) {
+    deadline_ms = storage.activity_deadlines[slot];
+    found = true;
+  }
+
+  if ((flags & (1 << FLAG_CYCLE_ENABLED)) && storage.phases[slot]) {
+    unsigned long phase_deadline_ms = storage.phase_deadlines[slot];
+    deadline_ms = found ? hal::earliest(deadline_ms, phase_deadline_ms)
+                        : phase_deadline_ms;
+    found = true;
+  }
+
+  return found;
+}
+
+// view
+BankedTrafficLight::BankedTrafficLight(TrafficLightBankBase *bank, int slot)
+    : bank(bank), slot(slot), pattern{false, false, false} {}
+
+bool BankedTrafficLight::is_valid() { return bank != nullptr; }
+
+int BankedTrafficLight::get_slot() { return slot; }
+
+bool BankedTrafficLight::is_cycle_enabled() {
+  return bank->is_cycle_enabled(slot);
+}
+
+bool BankedTrafficLight::is_activity_cycle_enabled() {
+  return bank->is_activity_cycle_enabled(slot);
+}
+
+bool *BankedTrafficLight::get_pattern() {
+  uint8_t mask = bank->get_pattern_mask(slot);
+  for (int i = 0; i < TrafficLightBankBase::NUM_LIGHTS; i++) {
+    pattern[i] = (mask & (1 << i)) != 0;
+  }
+  return pattern;
+}
+
+void BankedTrafficLight::set_pattern(bool red_light, bool yellow_light,
+                                     bool green_light) {
+  bank->set_pattern(slot, red_light, yellow_light, green_light);
+}
+
+void BankedTrafficLight::set_cycle_repetitions_limit(
+    unsigned long repetitions_limit) {
+  bank->set_cycle_repetitions_limit(slot, repetitions_limit);
+}
+
+void BankedTrafficLight::set_cycle_phases(const Phase *phases,
+                                          int phase_count) {
+  bank->set_cycle_phases(slot, phases, phase_count);
+}
+
+void BankedTrafficLight::set_activity_cycle_times(
+    unsigned long active_time_ms, unsigned long inactive_time_ms) {
+  bank->set_activity_cycle_times(slot, active_time_ms, inactive_time_ms);
+}
+
+void BankedTrafficLight::set_auto_lights_off(bool enabled) {
+  bank->set_auto_lights_off(slot, enabled);
+}
+
+void BankedTrafficLight::enable_cycle() { bank->enable_cycle(slot); }
+
+void BankedTrafficLight::disable_cycle() { bank->disable_cycle(slot); }
+
+void BankedTrafficLight::enable_activity_cycle() {
+  bank->enable_activity_cycle(slot);
+}
+
+void BankedTrafficLight::disable_activity_cycle() {
+  bank->disable_activity_cycle(slot);
+}
+
+void BankedTrafficLight::register_event(EventName name, void (*callback)()) {
+  bank->register_event(slot, name, callback);
+}
+
+void BankedTrafficLight::unregister_event(EventName name) {
+  bank->unregister_event(slot, name);
+}
+
+void BankedTrafficLight::subscribe_event(EventListener &listener) {
+  bank->subscribe_event(slot, listener);
+}
+
+void BankedTrafficLight::unsubscribe_event(EventListener &listener) {
+  bank->unsubscribe_event(slot, listener);
+}
+
+bool BankedTrafficLight::get_next_deadline(unsigned long &deadline_ms) {
+  return bank->get_next_deadline(slot, deadline_ms);
+}
+
+void BankedTrafficLight::update() { bank->update(slot); }
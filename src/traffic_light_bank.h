@@ -0,0 +1,262 @@
+#ifndef TRAFFIC_LIGHT_BANK_H
+#define TRAFFIC_LIGHT_BANK_H
+
+#include "events.h"
+#include "phase.h"
+#include <stdint.h>
+
+class BankedTrafficLight;
+
+/**
+ * Runs many traffic lights in one pass.
+ * The state of all lights is kept in contiguous arrays (one array per field)
+ * and update() advances every light with a single read of the clock.
+ * Phases are not copied, the phase arrays must stay valid while in use.
+ * Defect detection is not supported, use TrafficLight for lights with test
+ * pins.
+ *
+ * Use the TrafficLightBank template to get a bank with its storage.
+ */
+class TrafficLightBankBase {
+public:
+  static constexpr int NUM_LIGHTS = 3;
+
+  /**
+   * Adds a traffic light to the bank.
+   * @param red_pin The pin connected to the red light.
+   * @param yellow_pin The pin connected to the yellow light.
+   * @param green_pin The pin connected to the green light.
+   * @return The view onto the new light, invalid if the bank is full.
+   */
+  BankedTrafficLight add(int red_pin, int yellow_pin, int green_pin);
+
+  /**
+   * Gets a view onto a light of the bank.
+   * @param slot The slot of the light.
+   * @return The view onto the light.
+   */
+  BankedTrafficLight get(int slot);
+
+  /**
+   * Gets the number of lights in the bank.
+   * @return The number of lights.
+   */
+  int get_count();
+
+  /**
+   * Gets the maximum number of lights in the bank.
+   * @return The capacity of the bank.
+   */
+  int get_capacity();
+
+  /**
+   * Sets a queue deferring the events of all lights of the bank.
+   * @param queue The queue, nullptr to deliver events during update().
+   */
+  void set_event_queue(EventQueueBase *queue);
+
+  /**
+   * Updates all lights of the bank.
+   */
+  void update();
+
+  /**
+   * Updates a single light of the bank.
+   * @param slot The slot of the light.
+   */
+  void update(int slot);
+
+  /**
+   * Gets the point in time the bank next needs an update.
+   * @param deadline_ms Set to the earliest deadline of all lights in
+   * milliseconds.
+   * @return True if there is a deadline, false if nothing is scheduled.
+   */
+  bool get_next_deadline(unsigned long &deadline_ms);
+
+  /**
+   * Idles until the next deadline, so the CPU is not spent on polling.
+   * Call update() afterwards.
+   * @param max_idle_ms The maximum time in milliseconds to idle.
+   */
+  void idle(unsigned long max_idle_ms = 1000);
+
+  // Per light operations, see TrafficLight for their documentation
+  bool is_cycle_enabled(int slot);
+  bool is_activity_cycle_enabled(int slot);
+  uint8_t get_pattern_mask(int slot);
+  void set_pattern(int slot, bool red_light, bool yellow_light,
+                   bool green_light);
+  void set_cycle_repetitions_limit(int slot, unsigned long repetitions_limit);
+  void set_cycle_phases(int slot, const Phase *phases, int phase_count);
+  void set_activity_cycle_times(int slot, unsigned long active_time_ms,
+                                unsigned long inactive_time_ms);
+  void set_auto_lights_off(int slot, bool enabled);
+  void enable_cycle(int slot);
+  void disable_cycle(int slot);
+  void enable_activity_cycle(int slot);
+  void disable_activity_cycle(int slot);
+  void register_event(int slot, EventName name, void (*callback)());
+  void unregister_event(int slot, EventName name);
+  void subscribe_event(int slot, EventListener &listener);
+  void unsubscribe_event(int slot, EventListener &listener);
+  bool get_next_deadline(int slot, unsigned long &deadline_ms);
+
+protected:
+  /**
+   * Pointers to the per light arrays, each with capacity elements.
+   */
+  struct Storage {
+    int (*light_pins)[NUM_LIGHTS];
+    uint8_t *flags;
+    uint8_t *patterns;
+    uint8_t *written_patterns;
+    const Phase **phases;
+    int *phase_counts;
+    int *phase_indices;
+    unsigned long *phase_deadlines;
+    unsigned long *repetitions_limits;
+    unsigned long *repetitions_counts;
+    unsigned long *activity_deadlines;
+    unsigned long *active_times;
+    unsigned long *inactive_times;
+    EventManager *event_managers;
+  };
+
+  TrafficLightBankBase(const Storage &storage, int capacity);
+
+private:
+  // Bit positions for flags
+  static constexpr uint8_t FLAG_CYCLE_ENABLED = 0;
+  static constexpr uint8_t FLAG_ACTIVITY_ENABLED = 1;
+  static constexpr uint8_t FLAG_INACTIVE = 2;
+  static constexpr uint8_t FLAG_AUTO_LIGHTS_OFF = 3;
+
+  Storage storage;
+  int capacity;
+  int count;
+  EventQueueBase *event_queue;
+
+  // Disable copy constructor and assignment
+  TrafficLightBankBase(const TrafficLightBankBase &) = delete;
+  TrafficLightBankBase &operator=(const TrafficLightBankBase &) = delete;
+
+  /**
+   * Advances a light, assumes the clock has been read.
+   */
+  void update_slot(int slot, unsigned long now);
+
+  /**
+   * Toggles the activity state of a light.
+   */
+  void toggle_activity(int slot, unsigned long now);
+
+  /**
+   * Advances the cycle of a light to the next phase.
+   */
+  void advance_phase(int slot, unsigned long now);
+
+  /**
+   * Starts the cycle of a light at its first phase.
+   */
+  void start_cycle(int slot, unsigned long now);
+
+  /**
+   * Emits an event of a light, if anyone listens to it.
+   */
+  void emit(int slot, EventName name);
+
+  /**
+   * Writes the pins of a light whose pattern changed.
+   */
+  void write_pattern(int slot);
+};
+
+/**
+ * Traffic light bank with storage for a fixed number of lights.
+ */
+template <int CAPACITY> class TrafficLightBank : public TrafficLightBankBase {
+private:
+  int light_pins[CAPACITY][NUM_LIGHTS];
+  uint8_t flags[CAPACITY];
+  uint8_t patterns[CAPACITY];
+  uint8_t written_patterns[CAPACITY];
+  const Phase *phases[CAPACITY];
+  int phase_counts[CAPACITY];
+  int phase_indices[CAPACITY];
+  unsigned long phase_deadlines[CAPACITY];
+  unsigned long repetitions_limits[CAPACITY];
+  unsigned long repetitions_counts[CAPACITY];
+  unsigned long activity_deadlines[CAPACITY];
+  unsigned long active_times[CAPACITY];
+  unsigned long inactive_times[CAPACITY];
+  EventManager event_managers[CAPACITY];
+
+public:
+  TrafficLightBank()
+      : TrafficLightBankBase(
+            Storage{light_pins, flags, patterns, written_patterns, phases,
+                    phase_counts, phase_indices, phase_deadlines,
+                    repetitions_limits, repetitions_counts, activity_deadlines,
+                    active_times, inactive_times, event_managers},
+            CAPACITY) {}
+};
+
+/**
+ * View onto one light of a TrafficLightBank.
+ * Offers the same interface as TrafficLight, so existing code can drive a
+ * banked light unchanged. Views are cheap to copy.
+ */
+class BankedTrafficLight {
+private:
+  TrafficLightBankBase *bank;
+  int slot;
+  bool pattern[TrafficLightBankBase::NUM_LIGHTS];
+
+public:
+  BankedTrafficLight(TrafficLightBankBase *bank, int slot);
+
+  /**
+   * Checks if the view refers to a light.
+   * @return True if the view is valid, false otherwise.
+   */
+  bool is_valid();
+
+  /**
+   * Gets the slot of the light in its bank.
+   * @return The slot.
+   */
+  int get_slot();
+
+  bool is_cycle_enabled();
+  bool is_activity_cycle_enabled();
+
+  /**
+   * Gets the current pattern of the traffic light.
+   * @return A copy of the pattern, valid until the next call.
+   */
+  bool *get_pattern();
+
+  void set_pattern(bool red_light, bool yellow_light, bool green_light);
+  void set_cycle_repetitions_limit(unsigned long repetitions_limit = 0);
+  void set_cycle_phases(const Phase *phases, int phase_count);
+  void set_activity_cycle_times(unsigned long active_time_ms,
+                                unsigned long inactive_time_ms);
+  void set_auto_lights_off(bool enabled);
+  void enable_cycle();
+  void disable_cycle();
+  void enable_activity_cycle();
+  void disable_activity_cycle();
+  void register_event(EventName name, void (*callback)());
+  void unregister_event(EventName name);
+  void subscribe_event(EventListener &listener);
+  void unsubscribe_event(EventListener &listener);
+  bool get_next_deadline(unsigned long &deadline_ms);
+
+  /**
+   * Updates only this light, prefer updating the whole bank.
+   */
+  void update();
+};
+
+#endif